@@ -10,6 +10,7 @@ using namespace std;
 #include <execution>
 
 #include "pixeltypes.h" // Assuming this defines the CRGB structure
+#include "pixelkernels.h"
 #include "interfaces.h"
 
 class BaseGraphics : public ILEDGraphics
@@ -19,7 +20,7 @@ protected:
     uint32_t _height;
     vector<CRGB> _pixels;
 
-    virtual inline __attribute__((always_inline)) uint32_t _index(uint32_t x, uint32_t y) const
+    inline __attribute__((always_inline)) uint32_t _index(uint32_t x, uint32_t y) const
     {
         return y * _width + x;
     }
@@ -29,6 +30,18 @@ protected:
         return (x < _width && y < _height);
     }
 
+    uint8_t * Bytes()
+    {
+        return reinterpret_cast<uint8_t *>(_pixels.data());
+    }
+
+    const uint8_t * SameSizeBytes(const ILEDGraphics& other) const
+    {
+        if (other.Width() != _width || other.Height() != _height)
+            throw invalid_argument("Frames to combine must be the same size");
+        return reinterpret_cast<const uint8_t *>(other.GetPixels().data());
+    }
+
 public:
     explicit BaseGraphics(uint32_t width, uint32_t height)
     {
@@ -60,6 +73,29 @@ public:
         return _pixels;
     }
 
+    span<CRGB> Pixels() override
+    {
+        return _pixels;
+    }
+
+    // Row
+    //
+    // Effects that draw every pixel write through these rather than calling SetPixel for each
+    // one, which leaves the compiler a plain loop over memory
+
+    span<CRGB> Row(uint32_t y) override
+    {
+        if (y >= _height)
+            throw out_of_range("Row " + to_string(y) + " is outside the graphics");
+        return span<CRGB>(_pixels).subspan(_index(0, y), _width);
+    }
+
+    void WritePixels(uint32_t x, uint32_t y, span<const CRGB> pixels) override
+    {
+        if (_isInBounds(x, y))
+            copy_n(pixels.begin(), min<size_t>(pixels.size(), _width - x), &_pixels[_index(x, y)]);
+    }
+
     void SetPixel(uint32_t x, uint32_t y, const CRGB& color) override
     {
         if (_isInBounds(x, y))
@@ -84,12 +120,21 @@ public:
         width = min(width, _width - x);
         height = min(height, _height - y);
 
+        // Rows that span the whole width are one run of pixels
+
+        if (width == _width)
+        {
+            width *= height;
+            height = 1;
+        }
+
         if (color == CRGB::Black) {
             for (uint32_t j = y; j < y + height; ++j)
                 memset(&_pixels[_index(x, j)], 0, width * sizeof(CRGB));
         } else {
+            const auto &kernels = PixelKernels::Active();
             for (uint32_t j = y; j < y + height; ++j)
-                fill(&_pixels[_index(x, j)], &_pixels[_index(x + width, j)], color);
+                kernels.fill(&_pixels[_index(x, j)], width, color);
         }
     }
 
@@ -166,13 +211,22 @@ public:
 
     void FadeFrameBy(uint8_t dimAmount) override
     {
-        const uint8_t scale = 255 - dimAmount;
-        for_each(_pixels.begin(), _pixels.end(),
-            [scale](CRGB& p) {
-                p.r = (p.r * scale) >> 8;
-                p.g = (p.g * scale) >> 8;
-                p.b = (p.b * scale) >> 8;
-            });
+        ScaleFrame(255 - dimAmount);
+    }
+
+    void ScaleFrame(uint8_t scale) override
+    {
+        PixelKernels::Active().scale(Bytes(), _pixels.size() * sizeof(CRGB), scale);
+    }
+
+    void AddFrame(const ILEDGraphics& other) override
+    {
+        PixelKernels::Active().addSaturate(Bytes(), SameSizeBytes(other), _pixels.size() * sizeof(CRGB));
+    }
+
+    void BlendFrame(const ILEDGraphics& other, uint16_t weight) override
+    {
+        PixelKernels::Active().blend(Bytes(), SameSizeBytes(other), _pixels.size() * sizeof(CRGB), min<uint16_t>(weight, 256));
     }
 
     void SetPixelsF(float fPos, float count, CRGB c, bool bMerge = false) override
@@ -0,0 +1,150 @@
+// compressbench
+//
+// Measures what it costs to compress one frame for each of a few typical canvas sizes, the
+// old way (a fresh deflate stream per frame and an output buffer grown 1 KB at a time) against
+// FrameCompressor (one stream per channel, reset between frames, pooled output buffers), and
+// the run-length-only zlib strategy the Rle codec uses.  The last column is what a frame costs
+// when only its header changed, which FrameEncoder serves from its compressed pixel cache.
+//
+// The frames are a slowly moving gradient, which is roughly what palette effects produce.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <zlib.h>
+
+#include "../framecodec.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// The per-frame compression SocketChannel used before it had a FrameCompressor
+
+static vector<uint8_t> LegacyCompress(const vector<uint8_t> &data)
+{
+    constexpr size_t bufferIncrement = 1024;
+    vector<uint8_t> compressedData(bufferIncrement);
+
+    z_stream stream{};
+    stream.next_in = const_cast<Bytef *>(data.data());
+    stream.avail_in = static_cast<uInt>(data.size());
+
+    if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK)
+        throw runtime_error("Failed to initialize zlib compression");
+
+    int result;
+    do
+    {
+        if (stream.total_out >= compressedData.size())
+            compressedData.resize(compressedData.size() + bufferIncrement);
+
+        stream.next_out = compressedData.data() + stream.total_out;
+        stream.avail_out = static_cast<uInt>(compressedData.size() - stream.total_out);
+
+        result = deflate(&stream, Z_FINISH);
+    } while (result != Z_STREAM_END);
+
+    deflateEnd(&stream);
+    compressedData.resize(stream.total_out);
+    return compressedData;
+}
+
+static vector<vector<uint8_t>> MakeFrames(size_t width, size_t height, size_t count)
+{
+    vector<vector<uint8_t>> frames(count, vector<uint8_t>(width * height * 3));
+    for (size_t f = 0; f < count; f++)
+        for (size_t y = 0; y < height; y++)
+            for (size_t x = 0; x < width; x++)
+            {
+                auto pixel = &frames[f][(y * width + x) * 3];
+                pixel[0] = static_cast<uint8_t>(x + f);
+                pixel[1] = static_cast<uint8_t>(y * 4 + f / 2);
+                pixel[2] = static_cast<uint8_t>(128 - x / 2);
+            }
+    return frames;
+}
+
+// NanosecondsPerFrame
+//
+// Best of several runs, so that a busy machine doesn't skew one side of the comparison
+
+template <typename Function>
+static double NanosecondsPerFrame(const vector<vector<uint8_t>> &frames, size_t iterations, Function compress)
+{
+    constexpr int runs = 5;
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < frames.size(); i++)             // Warm up caches and the pool
+        bytes += compress(frames[i]);
+
+    double best = numeric_limits<double>::max();
+    for (int run = 0; run < runs; run++)
+    {
+        auto start = steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            bytes += compress(frames[i % frames.size()]);
+        auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        best = min(best, static_cast<double>(elapsed) / iterations);
+    }
+
+    if (bytes == 0)
+        printf("(no output)\n");
+    return best;
+}
+
+int main()
+{
+    struct Size { size_t width, height; const char * name; };
+    const Size sizes[] = {
+        {   32,  1, "32 pixel strip" },
+        {  144,  1, "144 pixel strip" },
+        {   64, 32, "64x32 matrix" },
+        {  512, 32, "512x32 banner" },
+        { 1024, 64, "1024x64 window canvas" },
+    };
+
+    printf("%-24s %14s %14s %10s %14s %10s %10s %14s\n", "canvas", "legacy ns", "reused ns", "speedup", "rle ns", "zlib size", "rle size", "repeat ns");
+
+    for (const auto & size : sizes)
+    {
+        auto frames = MakeFrames(size.width, size.height, 64);
+        size_t iterations = max<size_t>(200, 4'000'000 / (size.width * size.height * 3));
+
+        double legacy = NanosecondsPerFrame(frames, iterations, [](const vector<uint8_t> &frame)
+        {
+            return LegacyCompress(frame).size();
+        });
+
+        FrameCompressor compressor;
+        double reused = NanosecondsPerFrame(frames, iterations, [&](const vector<uint8_t> &frame)
+        {
+            return compressor.Compress(frame.data(), frame.size(), 16)->size();
+        });
+
+        FrameCompressor rleCompressor(Z_BEST_SPEED, Z_RLE);
+        double rle = NanosecondsPerFrame(frames, iterations, [&](const vector<uint8_t> &frame)
+        {
+            return rleCompressor.Compress(frame.data(), frame.size(), 16)->size();
+        });
+
+        auto zlibSize = compressor.Compress(frames[0].data(), frames[0].size())->size();
+        auto rleSize = rleCompressor.Compress(frames[0].data(), frames[0].size())->size();
+
+        // Same pixels every time, with the timestamp bytes at the front changing
+
+        FrameEncoder encoder;
+        vector<vector<uint8_t>> repeats(2, frames[0]);
+        repeats[1][16] ^= 0xFF;
+        auto pixelHash = Utilities::HashBytes(frames[0].data() + 24, frames[0].size() - 24);
+        double repeat = NanosecondsPerFrame(repeats, iterations, [&](const vector<uint8_t> &frame)
+        {
+            return encoder.Encode(frame.data(), frame.size(), 0, 24, pixelHash)->size();
+        });
+
+        printf("%-24s %14.0f %14.0f %9.2fx %14.0f %10zu %10zu %14.0f\n", size.name, legacy, reused, legacy / reused, rle, zlibSize, rleSize, repeat);
+    }
+
+    return 0;
+}
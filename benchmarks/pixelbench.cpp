@@ -0,0 +1,143 @@
+// pixelbench
+//
+// Measures the bulk pixel operations for a few typical canvas sizes: the way BaseGraphics and
+// Utilities did them before PixelKernels, against every kernel level this CPU supports.  Times
+// are per frame, so they can be compared directly against a frame's time budget.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "../pixelkernels.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// The code the kernels replaced
+
+static void LegacyFade(vector<CRGB> &pixels, uint8_t dimAmount)
+{
+    const uint8_t scale = 255 - dimAmount;
+    for_each(pixels.begin(), pixels.end(), [scale](CRGB &p)
+    {
+        p.r = (p.r * scale) >> 8;
+        p.g = (p.g * scale) >> 8;
+        p.b = (p.b * scale) >> 8;
+    });
+}
+
+static void LegacyFill(vector<CRGB> &pixels, size_t width, CRGB color)
+{
+    for (size_t row = 0; row < pixels.size(); row += width)
+        fill(&pixels[row], &pixels[row] + width, color);
+}
+
+static void LegacyAdd(vector<CRGB> &pixels, const vector<CRGB> &other)
+{
+    for (size_t i = 0; i < pixels.size(); i++)
+        pixels[i] += other[i];
+}
+
+static void LegacyBlend(vector<CRGB> &pixels, const vector<CRGB> &other, uint16_t weight)
+{
+    auto d = reinterpret_cast<uint8_t *>(pixels.data());
+    auto s = reinterpret_cast<const uint8_t *>(other.data());
+    for (size_t i = 0; i < pixels.size() * 3; i++)
+        d[i] = static_cast<uint8_t>(d[i] + (((s[i] - d[i]) * weight) >> 8));
+}
+
+static void LegacySwap(const vector<CRGB> &pixels, uint8_t *out)
+{
+    for (const auto &pixel : pixels)
+    {
+        *out++ = pixel.g;
+        *out++ = pixel.r;
+        *out++ = pixel.b;
+    }
+}
+
+// NanosecondsPerFrame
+//
+// Best of several runs, so that a busy machine doesn't skew one side of the comparison
+
+template <typename Function>
+static double NanosecondsPerFrame(size_t iterations, Function operation)
+{
+    constexpr int runs = 5;
+
+    operation();
+    double best = numeric_limits<double>::max();
+    for (int run = 0; run < runs; run++)
+    {
+        auto start = steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            operation();
+        auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        best = min(best, static_cast<double>(elapsed) / iterations);
+    }
+    return best;
+}
+
+int main()
+{
+    struct Size { size_t width, height; const char * name; };
+    const Size sizes[] = {
+        {  144,  1, "144 pixel strip" },
+        {   64, 32, "64x32 matrix" },
+        {  512, 32, "512x32 banner" },
+        { 1024, 64, "1024x64 window canvas" },
+    };
+
+    vector<const PixelKernels *> levels;
+    for (auto level : { KernelLevel::Scalar, KernelLevel::SSE2, KernelLevel::AVX2 })
+        if (levels.empty() || PixelKernels::For(level).level != levels.back()->level)
+            levels.push_back(&PixelKernels::For(level));
+
+    printf("Active kernels: %s\n\n", PixelKernels::Active().name);
+    printf("%-24s %-8s %10s %10s %10s %10s %10s\n", "canvas", "kernels", "fade ns", "fill ns", "add ns", "blend ns", "swap ns");
+
+    for (const auto & size : sizes)
+    {
+        size_t count = size.width * size.height;
+        size_t iterations = max<size_t>(1000, 40'000'000 / (count * 3));
+
+        vector<CRGB> pixels(count), other(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            pixels[i] = CRGB(static_cast<uint8_t>(i), static_cast<uint8_t>(i * 3), static_cast<uint8_t>(255 - i));
+            other[i] = CRGB(static_cast<uint8_t>(i * 7), 40, static_cast<uint8_t>(i / 3));
+        }
+        vector<uint8_t> out(count * 3);
+
+        auto print = [&](const char *name, double fade, double fill, double add, double blend, double swap)
+        {
+            printf("%-24s %-8s %10.0f %10.0f %10.0f %10.0f %10.0f\n", size.name, name, fade, fill, add, blend, swap);
+        };
+
+        // The fades and adds saturate or drain the buffer after a while, which doesn't change
+        // the work the loops do
+
+        print("legacy",
+              NanosecondsPerFrame(iterations, [&] { LegacyFade(pixels, 10); }),
+              NanosecondsPerFrame(iterations, [&] { LegacyFill(pixels, size.width, CRGB(1, 2, 3)); }),
+              NanosecondsPerFrame(iterations, [&] { LegacyAdd(pixels, other); }),
+              NanosecondsPerFrame(iterations, [&] { LegacyBlend(pixels, other, 100); }),
+              NanosecondsPerFrame(iterations, [&] { LegacySwap(pixels, out.data()); }));
+
+        auto bytes = reinterpret_cast<uint8_t *>(pixels.data());
+        auto otherBytes = reinterpret_cast<const uint8_t *>(other.data());
+
+        for (const auto *kernels : levels)
+            print(kernels->name,
+                  NanosecondsPerFrame(iterations, [&] { kernels->scale(bytes, count * 3, 245); }),
+                  NanosecondsPerFrame(iterations, [&] { kernels->fill(pixels.data(), count, CRGB(1, 2, 3)); }),
+                  NanosecondsPerFrame(iterations, [&] { kernels->addSaturate(bytes, otherBytes, count * 3); }),
+                  NanosecondsPerFrame(iterations, [&] { kernels->blend(bytes, otherBytes, count * 3, 100); }),
+                  NanosecondsPerFrame(iterations, [&] { kernels->swapRedGreen(out.data(), bytes, count); }));
+    }
+
+    return 0;
+}
@@ -18,6 +18,7 @@ class Canvas : public ICanvas
     static atomic<uint32_t> _nextId;
     uint32_t                _id;
     BaseGraphics            _graphics;
+    BaseGraphics            _front;
     EffectsManager          _effects;
     string                  _name;
     vector<shared_ptr<ILEDFeature>> _features;
@@ -27,6 +28,7 @@ public:
     Canvas(string name, uint32_t width, uint32_t height, uint16_t fps = 30) :
         _id(NextId()),
         _graphics(width, height),
+        _front(width, height),
         _effects(fps),
         _name(name)
     {
@@ -75,6 +77,20 @@ public:
         return _graphics;
     }
 
+    const ILEDGraphics& FrontGraphics() const override
+    {
+        return _front;
+    }
+
+    // PresentFrame
+    //
+    // Copies rather than swaps, since many effects build on what they drew the frame before
+
+    void PresentFrame() override
+    {
+        _front = _graphics;
+    }
+
     IEffectsManager & Effects() override
     {
         lock_guard lock(_featuresMutex);
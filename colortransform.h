@@ -0,0 +1,164 @@
+#pragma once
+using namespace std;
+
+// ColorTransform
+//
+// The correction a feature applies to its pixels on the way out: gamma, the white balance of
+// its LEDs (a LEDColorCorrection), the color temperature it should look like (a
+// ColorTemperature) and a brightness limit.  Effects keep drawing in plain RGB; only the bytes
+// sent to the strip are changed.
+//
+// All four are folded into one 256-entry table per channel when the transform is made, so
+// applying it costs one lookup per byte no matter how many of them are in use.  The default
+// transform changes nothing, and the output code skips it entirely.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include "json.hpp"
+#include "pixeltypes.h"
+
+class ColorTransform
+{
+    double  _gamma       = 1.0;
+    CRGB    _correction  = CRGB(UncorrectedColor);
+    CRGB    _temperature = CRGB(UncorrectedTemperature);
+    uint8_t _brightness  = 255;
+
+    array<array<uint8_t, 256>, 3> _tables;              // Red, green and blue
+    bool _identity = true;
+
+    void BuildTables()
+    {
+        _identity = true;
+        for (size_t c = 0; c < _tables.size(); c++)
+        {
+            const double scale = (_correction.raw[c] / 255.0) * (_temperature.raw[c] / 255.0) * (_brightness / 255.0);
+            for (uint32_t value = 0; value < 256; value++)
+            {
+                double out = 255.0 * pow(value / 255.0, _gamma) * scale;
+                _tables[c][value] = static_cast<uint8_t>(lround(clamp(out, 0.0, 255.0)));
+                _identity = _identity && _tables[c][value] == value;
+            }
+        }
+    }
+
+public:
+    ColorTransform()
+    {
+        BuildTables();
+    }
+
+    ColorTransform(double gamma, CRGB correction, CRGB temperature, uint8_t brightness)
+        : _gamma(gamma),
+          _correction(correction),
+          _temperature(temperature),
+          _brightness(brightness)
+    {
+        if (!isfinite(gamma) || gamma <= 0.0)
+            throw invalid_argument("Gamma must be a positive number");
+
+        BuildTables();
+    }
+
+    double  Gamma()       const { return _gamma; }
+    CRGB    Correction()  const { return _correction; }
+    CRGB    Temperature() const { return _temperature; }
+    uint8_t Brightness()  const { return _brightness; }
+
+    // True when every table maps each value to itself, so the pixels can be copied untouched
+
+    bool IsIdentity() const
+    {
+        return _identity;
+    }
+
+    // The table for one channel of the source pixel, 0 for red through 2 for blue
+
+    const array<uint8_t, 256> & Table(size_t channel) const
+    {
+        return _tables[channel];
+    }
+
+    CRGB Apply(const CRGB &pixel) const
+    {
+        return CRGB(_tables[0][pixel.r], _tables[1][pixel.g], _tables[2][pixel.b]);
+    }
+
+    // Two transforms are the same when they produce the same bytes
+
+    bool operator==(const ColorTransform &other) const
+    {
+        return _tables == other._tables;
+    }
+};
+
+// The presets from pixeltypes.h can be given by name in the config, and any other value as a
+// color in the usual forms
+
+inline CRGB ColorPresetFromJson(const nlohmann::json &j, CRGB fallback)
+{
+    static const map<string, uint32_t> presets =
+    {
+        { "TypicalSMD5050",          TypicalSMD5050 },
+        { "TypicalLEDStrip",         TypicalLEDStrip },
+        { "Typical8mmPixel",         Typical8mmPixel },
+        { "TypicalPixelString",      TypicalPixelString },
+        { "UncorrectedColor",        UncorrectedColor },
+        { "Candle",                  Candle },
+        { "Tungsten40W",             Tungsten40W },
+        { "Tungsten100W",            Tungsten100W },
+        { "Halogen",                 Halogen },
+        { "CarbonArc",               CarbonArc },
+        { "HighNoonSun",             HighNoonSun },
+        { "DirectSunlight",          DirectSunlight },
+        { "OvercastSky",             OvercastSky },
+        { "ClearBlueSky",            ClearBlueSky },
+        { "WarmFluorescent",         WarmFluorescent },
+        { "StandardFluorescent",     StandardFluorescent },
+        { "CoolWhiteFluorescent",    CoolWhiteFluorescent },
+        { "FullSpectrumFluorescent", FullSpectrumFluorescent },
+        { "GrowLightFluorescent",    GrowLightFluorescent },
+        { "BlackLightFluorescent",   BlackLightFluorescent },
+        { "MercuryVapor",            MercuryVapor },
+        { "SodiumVapor",             SodiumVapor },
+        { "MetalHalide",             MetalHalide },
+        { "HighPressureSodium",      HighPressureSodium },
+        { "UncorrectedTemperature",  UncorrectedTemperature }
+    };
+
+    if (j.is_null())
+        return fallback;
+
+    if (j.is_string())
+    {
+        auto preset = presets.find(j.get<string>());
+        if (preset != presets.end())
+            return CRGB(preset->second);
+    }
+
+    return j.get<CRGB>();
+}
+
+inline void to_json(nlohmann::json &j, const ColorTransform &transform)
+{
+    j = {
+            {"gamma",            transform.Gamma()},
+            {"colorCorrection",  transform.Correction()},
+            {"colorTemperature", transform.Temperature()},
+            {"brightness",       transform.Brightness()}
+        };
+}
+
+inline void from_json(const nlohmann::json &j, ColorTransform &transform)
+{
+    transform = ColorTransform(
+        j.value("gamma", 1.0),
+        ColorPresetFromJson(j.value("colorCorrection", nlohmann::json()), CRGB(UncorrectedColor)),
+        ColorPresetFromJson(j.value("colorTemperature", nlohmann::json()), CRGB(UncorrectedTemperature)),
+        j.value("brightness", uint8_t(255)));
+}
@@ -0,0 +1,115 @@
+#pragma once
+using namespace std;
+
+// Compositor
+//
+// Blend kernels for combining one layer of pixels onto another.  They work on the pixels as a
+// flat run of bytes, since every channel is blended the same way, with 16-bit integer math and
+// no branches in the loop so the compiler can vectorize them.  Alpha and full-strength add are
+// the common cases and use the hand-vectorized PixelKernels.  Opacity is a fixed-point weight
+// from 0 (layer invisible) to 256 (layer at full strength).
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include "json.hpp"
+#include "pixeltypes.h"
+#include "pixelkernels.h"
+
+// BlendMode
+//
+// How a layer combines with what's beneath it
+
+enum class BlendMode : uint8_t
+{
+    Alpha,          // Mix toward the layer by its opacity; an opaque layer hides everything below
+    Add,            // Brighten by the layer, saturating at full brightness
+    Max,            // Keep the brighter of the two
+    Multiply        // Darken by the layer, so black masks and white leaves things unchanged
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(BlendMode, {
+    { BlendMode::Alpha,    "alpha"    },
+    { BlendMode::Add,      "add"      },
+    { BlendMode::Max,      "max"      },
+    { BlendMode::Multiply, "multiply" }
+})
+
+class Compositor
+{
+public:
+    static constexpr uint16_t kOpaque = 256;
+
+    static uint16_t OpacityWeight(double opacity)
+    {
+        return static_cast<uint16_t>(lround(clamp(opacity, 0.0, 1.0) * kOpaque));
+    }
+
+    // Whether a layer in this mode at this weight completely replaces what's below it
+
+    static bool Covers(BlendMode mode, uint16_t weight)
+    {
+        return mode == BlendMode::Alpha && weight >= kOpaque;
+    }
+
+    static void Blend(BlendMode mode, CRGB * __restrict dst, const CRGB * __restrict src, size_t count, uint16_t weight)
+    {
+        auto d = reinterpret_cast<uint8_t *>(dst);
+        auto s = reinterpret_cast<const uint8_t *>(src);
+        size_t bytes = count * sizeof(CRGB);
+
+        switch (mode)
+        {
+            case BlendMode::Alpha:    PixelKernels::Active().blend(d, s, bytes, min(weight, kOpaque)); break;
+            case BlendMode::Add:      BlendAdd(d, s, bytes, weight);      break;
+            case BlendMode::Max:      BlendMax(d, s, bytes, weight);      break;
+            case BlendMode::Multiply: BlendMultiply(d, s, bytes, weight); break;
+        }
+    }
+
+    static void BlendAdd(uint8_t * __restrict d, const uint8_t * __restrict s, size_t bytes, uint16_t weight)
+    {
+        if (weight >= kOpaque)
+            return PixelKernels::Active().addSaturate(d, s, bytes);
+
+        for (size_t i = 0; i < bytes; i++)
+            d[i] = static_cast<uint8_t>(min(255, d[i] + ((s[i] * weight) >> 8)));
+    }
+
+    static void BlendMax(uint8_t * __restrict d, const uint8_t * __restrict s, size_t bytes, uint16_t weight)
+    {
+        for (size_t i = 0; i < bytes; i++)
+            d[i] = static_cast<uint8_t>(max<int>(d[i], (s[i] * weight) >> 8));
+    }
+
+    // Multiplies by (s + 1) / 256 so white leaves the pixel exactly as it was, then mixes that
+    // in by the layer's weight
+
+    static void BlendMultiply(uint8_t * __restrict d, const uint8_t * __restrict s, size_t bytes, uint16_t weight)
+    {
+        for (size_t i = 0; i < bytes; i++)
+        {
+            int product = (d[i] * (s[i] + 1)) >> 8;
+            d[i] = static_cast<uint8_t>(d[i] + (((product - d[i]) * weight) >> 8));
+        }
+    }
+
+    // Select
+    //
+    // Takes the layer's pixel wherever the mask is below the threshold, so raising the threshold
+    // from 0 to 256 over a random mask dissolves from one image to the other
+
+    static void Select(CRGB * __restrict dst, const CRGB * __restrict src, const uint8_t * __restrict mask, size_t count, uint16_t threshold)
+    {
+        auto d = reinterpret_cast<uint8_t *>(dst);
+        auto s = reinterpret_cast<const uint8_t *>(src);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint8_t keep = mask[i] < threshold ? 0 : 0xFF;
+            for (size_t c = 0; c < sizeof(CRGB); c++)
+                d[i * sizeof(CRGB) + c] = (d[i * sizeof(CRGB) + c] & keep) | (s[i * sizeof(CRGB) + c] & ~keep);
+        }
+    }
+};
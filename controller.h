@@ -33,6 +33,9 @@ class Controller : public IController
 
     vector<shared_ptr<ICanvas>> _canvases;
     uint16_t                    _port;
+    uint16_t                    _ioThreads = 0;
+    uint16_t                    _encodeThreads = 0;
+    uint16_t                    _renderThreads = 0;
     mutable mutex               _canvasMutex;
 
   public:
@@ -90,6 +93,55 @@ class Controller : public IController
         _port = port;
     }
 
+    uint16_t GetIOThreads() const override
+    {
+        return _ioThreads;
+    }
+
+    // SetIOThreads
+    //
+    // Selects the socket I/O engine for channels started from here on: zero keeps the classic
+    // thread-per-socket model, anything else routes all sockets through that many shared
+    // reactor threads.
+
+    void SetIOThreads(uint16_t threads) override
+    {
+        _ioThreads = threads;
+        SocketReactor::Instance().SetThreadCount(threads);
+    }
+
+    uint16_t GetEncodeThreads() const override
+    {
+        return _encodeThreads;
+    }
+
+    // SetEncodeThreads
+    //
+    // Sizes the shared WorkerPool that canvases encode their features on.  Zero encodes each
+    // canvas's features one after the other on its own thread, as before.
+
+    void SetEncodeThreads(uint16_t threads) override
+    {
+        _encodeThreads = threads;
+        WorkerPool::Instance().SetThreadCount(threads);
+    }
+
+    uint16_t GetRenderThreads() const override
+    {
+        return _renderThreads;
+    }
+
+    // SetRenderThreads
+    //
+    // Selects how canvases started from here on are driven: zero gives each its own render
+    // thread, anything else schedules all of them on that many shared FrameScheduler threads.
+
+    void SetRenderThreads(uint16_t threads) override
+    {
+        _renderThreads = threads;
+        FrameScheduler::Instance().SetThreadCount(threads);
+    }
+
     bool AddFeatureToCanvas(uint16_t canvasId, shared_ptr<ILEDFeature> feature) override
     {
         lock_guard lock(_canvasMutex);
@@ -544,6 +596,9 @@ inline void to_json(nlohmann::json &j, const IController &controller)
     try
     {
         j["port"] = controller.GetPort();
+        j["ioThreads"] = controller.GetIOThreads();
+        j["encodeThreads"] = controller.GetEncodeThreads();
+        j["renderThreads"] = controller.GetRenderThreads();
         j["canvases"] = nlohmann::json::array();
         for (const auto &canvas : controller.Canvases())
             j["canvases"].push_back(*canvas);
@@ -565,6 +620,9 @@ inline void from_json(const nlohmann::json &j, unique_ptr<Controller> & ptrContr
 
         // Create controller
         ptrController = make_unique<Controller>(port);
+        ptrController->SetIOThreads(j.value("ioThreads", uint16_t(0)));
+        ptrController->SetEncodeThreads(j.value("encodeThreads", uint16_t(0)));
+        ptrController->SetRenderThreads(j.value("renderThreads", uint16_t(0)));
 
         // Extract canvases
         for (const auto &canvasJson : j.value("canvases", nlohmann::json::array()))
@@ -27,6 +27,11 @@ public:
         _time = 0.0;
     }
 
+    bool IsDeterministic() const override
+    {
+        return true;
+    }
+
     void Update(ICanvas& canvas, microseconds deltaTime) override
     {
         _time += _speed * deltaTime.count() / 1000000.0;
@@ -37,6 +42,8 @@ public:
 
         for (int y = 0; y < height; ++y)
         {
+            auto row = graphics.Row(y);
+
             for (int x = 0; x < width; ++x)
             {
                 // Create some "dancing" waves using multiple sine waves
@@ -79,8 +86,7 @@ public:
                 brightness *= curtain;
 
                 // Max saturation for visibility
-                CRGB color = CRGB::HSV2RGB(hue, 1.0, brightness);
-                graphics.SetPixel(x, y, color);
+                row[x] = CRGB::HSV2RGB(hue, 1.0, brightness);
             }
         }
     }
@@ -27,6 +27,11 @@ public:
         _hue = 0.0;
     }
 
+    bool IsDeterministic() const override
+    {
+        return true;
+    }
+
     void Update(ICanvas& canvas, microseconds deltaTime) override
     {
         // Increment the hue based on speed and elapsed time
@@ -37,19 +42,20 @@ public:
         int width = graphics.Width();
         int height = graphics.Height();
 
-        // Draw the wave
-        for (int y = 0; y < height; ++y)
+        // Draw the wave along the first row; it only varies across, so the other rows are copies
+        auto wave = graphics.Row(0);
+        for (int x = 0; x < width; ++x)
         {
-            for (int x = 0; x < width; ++x)
-            {
-                // Calculate the hue based on position and wave frequency
-                double localHue = _hue + (x / static_cast<double>(width) * _waveFrequency);
-                if (localHue > 1.0) localHue -= 1.0; // Wrap around hue
+            // Calculate the hue based on position and wave frequency
+            double localHue = _hue + (x / static_cast<double>(width) * _waveFrequency);
+            if (localHue > 1.0) localHue -= 1.0; // Wrap around hue
 
-                // Convert the hue to RGB and draw the pixel
-                graphics.SetPixel(x, y, CRGB::HSV2RGB(localHue * 360.0)); 
-            }
+            // Convert the hue to RGB and draw the pixel
+            wave[x] = CRGB::HSV2RGB(localHue * 360.0);
         }
+
+        for (int y = 1; y < height; ++y)
+            graphics.WritePixels(0, y, wave);
     }
 
     friend inline void to_json(nlohmann::json& j, const ColorWaveEffect & effect);
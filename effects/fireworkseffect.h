@@ -7,6 +7,7 @@ using namespace std::chrono;
 #include "../ledeffectbase.h"
 #include "../pixeltypes.h"
 #include "../utilities.h"
+#include "../planarsurface.h"
 #include <vector>
 #include <random>
 #include <cmath>
@@ -61,6 +62,7 @@ private:
     vector<CRGB> _palette;
     queue<Particle> _particles;
     mt19937 _rng;
+    PlanarSurface _surface;         // The trails fade a little every frame, so they're kept in 16 bits
 
     double _maxSpeed = 175.0;
     double _newParticleProbability = 1.0;
@@ -97,13 +99,15 @@ public:
 
     void Update(ICanvas &canvas, microseconds deltaTime) override
     {
-        const auto ledCount = canvas.Graphics().Width() * canvas.Graphics().Height();
+        auto &graphics = canvas.Graphics();
+        const auto ledCount = graphics.Width() * graphics.Height();
+        _surface.Resize(graphics.Width(), graphics.Height());
 
         for (int i = 0; i < max(5, static_cast<int>(ledCount / 50)); ++i)
         {
             if (Utilities::RandomDouble(0.0, 1.0) < _newParticleProbability * 0.005)
             {
-                double startPos = Utilities::RandomDouble(0.0, static_cast<double>(canvas.Graphics().Width()));
+                double startPos = Utilities::RandomDouble(0.0, static_cast<double>(graphics.Width()));
                 CRGB color = CHSV(Utilities::RandomInt(0, 255), 255, 255);
                 int particleCount = Utilities::RandomInt(10, 50);
                 double multiplier = Utilities::RandomDouble(1.0, 3.0);
@@ -120,8 +124,7 @@ public:
             _particles.pop();
         }
 
-        // canvas.Graphics().Clear(CRGB::Black);
-        canvas.Graphics().FadeFrameBy(64);
+        _surface.FadeFrameBy(64);
 
         auto particleIter = _particles.front();
         while (!_particles.empty() && particleIter.Age() > _particleHoldTime + _particleIgnition + _particleFadeTime)
@@ -155,11 +158,13 @@ public:
             }
 
             _particleSize = max(1.0, (1.0 - fade) * (ledCount / 500.0));
-            canvas.Graphics().SetPixelsF(particle._position, _particleSize, color);
+            _surface.SetPixelsF(particle._position, _particleSize, color);
 
             newParticles.push(particle);
         }
         _particles.swap(newParticles);
+
+        _surface.Quantize(graphics);
     }
 
     friend inline void to_json(nlohmann::json &j, const FireworksEffect &effect);
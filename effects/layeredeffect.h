@@ -0,0 +1,141 @@
+#pragma once
+using namespace std;
+using namespace std::chrono;
+
+// LayeredEffect
+//
+// Runs several effects at once, each drawing into a layer of its own, and composites the layers
+// bottom to top onto the canvas with a blend mode and opacity per layer.  That lets a starfield
+// be laid over an aurora, say, without writing a combined effect.
+//
+// A layer that's opaque and blends by alpha hides everything below it, so the layers beneath
+// the topmost such layer aren't drawn at all and don't cost anything.
+
+#include "../interfaces.h"
+#include "../ledeffectbase.h"
+#include "../basegraphics.h"
+#include "../compositor.h"
+#include "../surfacecanvas.h"
+#include <vector>
+
+// Defined with the rest of the effect serialization in effectsmanager.h
+inline void to_json(nlohmann::json &j, const ILEDEffect &effect);
+inline void from_json(const nlohmann::json &j, shared_ptr<ILEDEffect> &effect);
+
+class LayeredEffect : public LEDEffectBase
+{
+public:
+    static constexpr const char* TypeName = "LayeredEffect";
+
+    struct Layer
+    {
+        shared_ptr<ILEDEffect> effect;
+        BlendMode              blend = BlendMode::Alpha;
+        double                 opacity = 1.0;
+    };
+
+private:
+    vector<Layer>        _layers;       // Bottom to top
+    vector<BaseGraphics> _surfaces;     // One per layer, sized to the canvas
+
+    // The surfaces follow the canvas size; a resized surface starts out black
+
+    void SizeSurfaces(const ILEDGraphics &graphics)
+    {
+        for (size_t i = _surfaces.size(); i < _layers.size(); i++)
+            _surfaces.emplace_back(graphics.Width(), graphics.Height());
+
+        for (auto &surface : _surfaces)
+            if (surface.Width() != graphics.Width() || surface.Height() != graphics.Height())
+                surface = BaseGraphics(graphics.Width(), graphics.Height());
+    }
+
+    // The lowest layer that will be seen
+
+    size_t FirstVisibleLayer() const
+    {
+        for (size_t i = _layers.size(); i-- > 0; )
+            if (Compositor::Covers(_layers[i].blend, Compositor::OpacityWeight(_layers[i].opacity)))
+                return i;
+        return 0;
+    }
+
+public:
+    LayeredEffect(const string& name, vector<Layer> layers = {})
+        : LEDEffectBase(name, TypeName), _layers(std::move(layers))
+    {
+    }
+
+    const vector<Layer> & Layers() const
+    {
+        return _layers;
+    }
+
+    void Start(ICanvas& canvas) override
+    {
+        SizeSurfaces(canvas.Graphics());
+        for (size_t i = 0; i < _layers.size(); i++)
+        {
+            SurfaceCanvas layerCanvas(canvas, _surfaces[i]);
+            _layers[i].effect->Start(layerCanvas);
+        }
+    }
+
+    bool IsDeterministic() const override
+    {
+        return all_of(_layers.begin(), _layers.end(), [](const Layer &layer) { return layer.effect->IsDeterministic(); });
+    }
+
+    void Update(ICanvas& canvas, microseconds deltaTime) override
+    {
+        auto &graphics = canvas.Graphics();
+        SizeSurfaces(graphics);
+
+        auto first = FirstVisibleLayer();
+        if (_layers.empty() || !Compositor::Covers(_layers[first].blend, Compositor::OpacityWeight(_layers[first].opacity)))
+            graphics.Clear(CRGB::Black);
+
+        size_t count = static_cast<size_t>(graphics.Width()) * graphics.Height();
+        for (size_t i = first; i < _layers.size(); i++)
+        {
+            SurfaceCanvas layerCanvas(canvas, _surfaces[i]);
+            _layers[i].effect->Update(layerCanvas, deltaTime);
+
+            Compositor::Blend(_layers[i].blend, graphics.Pixels().data(), _surfaces[i].Pixels().data(), count,
+                              Compositor::OpacityWeight(_layers[i].opacity));
+        }
+    }
+
+    friend inline void to_json(nlohmann::json& j, const LayeredEffect & effect);
+    friend inline void from_json(const nlohmann::json& j, shared_ptr<LayeredEffect>& effect);
+};
+
+inline void to_json(nlohmann::json& j, const LayeredEffect & effect)
+{
+    j = {
+        {"name", effect.Name()},
+        {"layers", nlohmann::json::array()}
+    };
+
+    for (const auto &layer : effect._layers)
+        j["layers"].push_back({
+            {"effect", *layer.effect},
+            {"blend", layer.blend},
+            {"opacity", layer.opacity}
+        });
+}
+
+inline void from_json(const nlohmann::json& j, shared_ptr<LayeredEffect>& effect)
+{
+    vector<LayeredEffect::Layer> layers;
+    for (const auto &layerJson : j.value("layers", nlohmann::json::array()))
+    {
+        LayeredEffect::Layer layer;
+        layer.effect = layerJson.at("effect").get<shared_ptr<ILEDEffect>>();
+        layer.blend = layerJson.value("blend", BlendMode::Alpha);
+        layer.opacity = layerJson.value("opacity", 1.0);
+        layers.push_back(std::move(layer));
+    }
+
+    effect = make_shared<LayeredEffect>(j.at("name").get<string>(), std::move(layers));
+}
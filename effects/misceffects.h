@@ -28,6 +28,11 @@ public:
     {
     }
 
+    bool IsDeterministic() const override
+    {
+        return true;
+    }
+
     void Update(ICanvas& canvas, microseconds deltaTime) override
     {
         canvas.Graphics().Clear(_color);
@@ -63,6 +68,11 @@ public:
     {
     }
 
+    bool IsDeterministic() const override
+    {
+        return true;
+    }
+
     void Update(ICanvas& canvas, microseconds deltaTime) override
     {
         (void) deltaTime;
@@ -78,10 +88,11 @@ public:
         // Fill the pixels with a rainbow pattern
         for (uint32_t y = 0; y < height; ++y)
         {
+            auto row = graphics.Row(y);
             for (uint32_t x = 0; x < width; ++x)
             {
                 const auto hue = static_cast<uint8_t>((x + y) % 256);
-                graphics.SetPixel(x, y, CHSV(hue, 255, 255));
+                row[x] = CHSV(hue, 255, 255);
             }
         }
     }
@@ -62,6 +62,11 @@ public:
     {
     }
 
+    bool IsDeterministic() const override
+    {
+        return true;
+    }
+
     void Update(ICanvas& canvas, microseconds deltaTime) override 
     {
         auto& graphics = canvas.Graphics();
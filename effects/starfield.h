@@ -58,6 +58,11 @@ public:
         canvas.Graphics().Clear(CRGB::Black);
     }
 
+    bool IsDeterministic() const override
+    {
+        return true;
+    }
+
     void Update(ICanvas& canvas, microseconds deltaTime) override
     {
         auto& graphics = canvas.Graphics();
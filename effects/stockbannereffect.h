@@ -688,14 +688,14 @@ private:
             return;
         }
 
+        // Each row of the window is the strip from the scroll offset on, wrapping to its start
+
         const uint32_t start = _scrollOffset % _stripWidth;
         for (uint32_t y = 0; y < canvasHeight; ++y)
         {
-            for (uint32_t x = 0; x < canvasWidth; ++x)
-            {
-                const uint32_t srcX = (start + x) % _stripWidth;
-                graphics.SetPixel(x, y, _stripPixels[static_cast<size_t>(y) * _stripWidth + srcX]);
-            }
+            const span<const CRGB> stripRow(&_stripPixels[static_cast<size_t>(y) * _stripWidth], _stripWidth);
+            for (uint32_t x = 0, srcX = start; x < canvasWidth; x += _stripWidth - srcX, srcX = 0)
+                graphics.WritePixels(x, y, stripRow.subspan(srcX, min(_stripWidth - srcX, canvasWidth - x)));
         }
     }
 
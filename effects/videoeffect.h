@@ -145,6 +145,11 @@ public:
             SWS_BILINEAR, nullptr, nullptr, nullptr);
     }
 
+    bool IsDeterministic() const override
+    {
+        return true;
+    }
+
     void Update(ICanvas& canvas, microseconds deltaTime) override
     {
         if (!_initialized)
@@ -160,26 +165,15 @@ public:
                     {
                         auto& graphics = canvas.Graphics();
                         int canvasWidth = graphics.Width();
-                        int canvasHeight = graphics.Height();
-
-                        // Buffer for RGB24 pixels
-                        vector<uint8_t> rgbBuffer(static_cast<size_t>(canvasWidth) * canvasHeight * sizeof(CRGB));
 
-                        uint8_t* dstData[1] = { rgbBuffer.data() };
+                        // The canvas is packed RGB24 row by row, so it's scaled straight into the canvas's
+                        // pixel buffer with no copy in between
+                        static_assert(sizeof(CRGB) == 3, "CRGB must be packed RGB24 to scale into it");
+                        uint8_t* dstData[1] = { reinterpret_cast<uint8_t*>(graphics.Pixels().data()) };
                         int dstLinesize[1] = { static_cast<int>(sizeof(CRGB) * canvasWidth) };
 
                         sws_scale(_swsCtx, _frame->data, _frame->linesize, 0, _codecCtx->height, dstData, dstLinesize);
 
-                        // Render to canvas
-                        for (int y = 0; y < canvasHeight; ++y)
-                        {
-                            for (int x = 0; x < canvasWidth; ++x)
-                            {
-                                int idx = (y * canvasWidth + x) * sizeof(CRGB);
-                                graphics.SetPixel(x, y, CRGB(rgbBuffer[idx], rgbBuffer[idx + 1], rgbBuffer[idx + 2]));
-                            }
-                        }
-
                         av_packet_unref(_packet);
                         return; // Process one frame per update
                     }
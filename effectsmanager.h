@@ -11,6 +11,7 @@ using namespace chrono;
 #include "effects/videoeffect.h"
 #include "effects/bouncingballeffect.h"
 #include "effects/auroraeffect.h"
+#include "effects/layeredeffect.h"
 
 // EffectsManager
 //
@@ -19,21 +20,71 @@ using namespace chrono;
 // can also be used to clear all effects.
 
 #include "interfaces.h"
+#include "featureframes.h"
+#include "workerpool.h"
+#include "framescheduler.h"
+#include "transition.h"
 #include <algorithm>
 #include <vector>
 #include <mutex>
+#include <future>
+#include <optional>
 
 class EffectsManager : public IEffectsManager
 {
+    using EffectList = vector<shared_ptr<ILEDEffect>>;
+
     uint16_t      _fps;
-    int           _currentEffectIndex; // Index of the current effect
+    atomic<int>   _currentEffectIndex; // Index of the current effect
     atomic<bool>  _running;
     bool          _wantsToRun;
-    mutable recursive_mutex _effectsMutex;  // Add recursive_mutex as member
-    vector<shared_ptr<ILEDEffect>> _effects;
+    mutex         _effectsMutex;             // Serializes edits to the effect list
+
+    // The effect list is never modified in place.  Edits publish a new copy, so the render loop
+    // can take a snapshot once per frame without locking and a slow API call can't stall it.
+    // Accessed only through atomic_load and atomic_store, since not every standard library
+    // we build with has atomic<shared_ptr>.
+    shared_ptr<const EffectList> _effects = make_shared<const EffectList>();
+
     thread        _workerThread;
+    uint64_t      _scheduledId = 0;            // Nonzero while the FrameScheduler drives us
+    bool          _pipelined = false;
+    milliseconds  _renderAhead = 0ms;
+    TransitionType _transitionType = TransitionType::Cut;
+    milliseconds  _transitionDuration = 0ms;
+    future<void>  _sending;                    // The previous frame, while it's encoded in the background
     bool          _lastScheduleState = true; // Track last schedule state to detect transitions
 
+    // FrameClock
+    //
+    // Everything the render loop carries from one frame to the next, so a frame can be rendered
+    // by whichever thread happens to be driving this canvas
+
+    struct FrameClock
+    {
+        steady_clock::duration   frameDuration;
+        // next two non-const because we may need to reset them if we fall behind
+        steady_clock::time_point startTimeSteady;
+        system_clock::time_point startTimeSystem;
+        steady_clock::time_point lastFrameTimeSteady;
+        steady_clock::time_point lastFrameTarget;      // When the previous frame is due to be shown
+        steady_clock::time_point lastHeartbeatTime;
+        long long                frameCount = 0;
+
+        shared_ptr<const EffectList> scheduledEffects; // The snapshot activeIndex refers to
+        system_clock::time_point nextScheduleCheck;
+        int                      activeIndex = -1;
+
+        shared_ptr<ILEDEffect>   renderedEffect;       // What the previous frame showed
+        optional<Transition>     transition;           // Away from a previous effect, while it runs
+    } _clock;
+
+    // Clock adjustments and daylight saving changes move the local-time boundaries that
+    // schedules are checked at, so a computed boundary is never trusted for longer than this
+    static constexpr auto kMaxScheduleRecheck = 60s;
+
+    friend class EffectsManagerTest;
+
 public:
     EffectsManager(uint16_t fps) : _fps(fps), _currentEffectIndex(-1), _wantsToRun(true), _running(false), _lastScheduleState(true) // No effect selected initially
     {
@@ -54,6 +105,58 @@ public:
         return _fps;
     }
 
+    bool IsPipelined() const override
+    {
+        return _pipelined;
+    }
+
+    // SetPipelined
+    //
+    // When pipelined, each frame is encoded and queued on the WorkerPool while the next one is
+    // being drawn.  That needs encode threads; without them it makes no difference.
+
+    void SetPipelined(bool pipelined) override
+    {
+        _pipelined = pipelined;
+    }
+
+    milliseconds GetRenderAhead() const override
+    {
+        return _renderAhead;
+    }
+
+    // SetRenderAhead
+    //
+    // How far ahead of their display time frames may be rendered when the current effect is
+    // deterministic.  Frames are then rendered in bursts until they're this far ahead, after
+    // which the canvas sleeps until half of the lead has been used up.  Zero renders in real time.
+
+    void SetRenderAhead(milliseconds lead) override
+    {
+        _renderAhead = max(lead, 0ms);
+    }
+
+    TransitionType GetTransitionType() const override
+    {
+        return _transitionType;
+    }
+
+    milliseconds GetTransitionDuration() const override
+    {
+        return _transitionDuration;
+    }
+
+    // SetTransition
+    //
+    // How the canvas changes over when a different effect takes over, and over how long.  A cut
+    // or a zero duration switches straight over.  Applies to the next change of effect.
+
+    void SetTransition(TransitionType type, milliseconds duration) override
+    {
+        _transitionType = type;
+        _transitionDuration = max(duration, 0ms);
+    }
+
     size_t GetCurrentEffect() const override
     {
         return _currentEffectIndex;
@@ -61,63 +164,65 @@ public:
 
     size_t EffectCount() const override
     {
-        return _effects.size();
+        return Snapshot()->size();
     }
 
     vector<shared_ptr<ILEDEffect>> Effects() const override
     {
-        lock_guard lock(_effectsMutex);
-        return _effects;
+        return *Snapshot();
     }
 
     // Add an effect to the manager
     void AddEffect(shared_ptr<ILEDEffect> effect) override
     {
-        lock_guard lock(_effectsMutex);
-
         if (!effect)
             throw invalid_argument("Cannot add a null effect.");
-        _effects.push_back(effect);
 
-        // Automatically set the first effect as current if none is selected
-        if (_currentEffectIndex == -1)
-            _currentEffectIndex = 0;
+        EditEffects([&](EffectList &effects)
+        {
+            effects.push_back(effect);
+
+            // Automatically set the first effect as current if none is selected
+            if (_currentEffectIndex == -1)
+                _currentEffectIndex = 0;
+        });
     }
 
     // Remove an effect from the manager
     void RemoveEffect(shared_ptr<ILEDEffect> &effect) override
     {
-        lock_guard lock(_effectsMutex);
-
         if (!effect)
             throw invalid_argument("Cannot remove a null effect.");
 
-        auto it = remove(_effects.begin(), _effects.end(), effect);
-        if (it != _effects.end())
+        EditEffects([&](EffectList &effects)
         {
-            auto index = distance(_effects.begin(), it);
-            _effects.erase(it);
+            auto it = remove(effects.begin(), effects.end(), effect);
+            if (it != effects.end())
+            {
+                auto index = distance(effects.begin(), it);
+                effects.erase(it);
 
-            // Adjust the current effect index
-            if (index <= _currentEffectIndex)
-                _currentEffectIndex = (_currentEffectIndex > 0) ? _currentEffectIndex - 1 : -1;
+                // Adjust the current effect index
+                if (index <= _currentEffectIndex)
+                    _currentEffectIndex = (_currentEffectIndex > 0) ? _currentEffectIndex - 1 : -1;
 
-            // If no effects remain, reset the current index
-            if (_effects.empty())
-                _currentEffectIndex = -1;
-        }
+                // If no effects remain, reset the current index
+                if (effects.empty())
+                    _currentEffectIndex = -1;
+            }
+        });
     }
 
     // Start the current effect
     void StartCurrentEffect(ICanvas &canvas) override
     {
-        if (_running && IsEffectSelected())
-            _effects[_currentEffectIndex]->Start(canvas);
+        if (auto effect = CurrentEffect(*Snapshot()); _running && effect)
+            effect->Start(canvas);
     }
 
     void SetCurrentEffect(size_t index, ICanvas &canvas) override
     {
-        if (index >= _effects.size())
+        if (index >= EffectCount())
             throw out_of_range("Effect index out of range.");
 
         _currentEffectIndex = index;
@@ -128,29 +233,29 @@ public:
     // Update the current effect and render it to the canvas
     void UpdateCurrentEffect(ICanvas &canvas, microseconds microsDelta) override
     {
-        if (IsEffectSelected())
-            _effects[_currentEffectIndex]->Update(canvas, microsDelta);
+        if (auto effect = CurrentEffect(*Snapshot()))
+            effect->Update(canvas, microsDelta);
     }
 
     // Switch to the next effect
     void NextEffect() override
     {
-        if (!_effects.empty())
-            _currentEffectIndex = (_currentEffectIndex + 1) % _effects.size();
+        if (auto count = static_cast<int>(EffectCount()))
+            _currentEffectIndex = (_currentEffectIndex + 1) % count;
     }
 
     // Switch to the previous effect
     void PreviousEffect() override
     {
-        if (!_effects.empty())
-            _currentEffectIndex = (_currentEffectIndex == 0) ? _effects.size() - 1 : _currentEffectIndex - 1;
+        if (auto count = static_cast<int>(EffectCount()))
+            _currentEffectIndex = (_currentEffectIndex <= 0) ? count - 1 : _currentEffectIndex - 1;
     }
 
     // Get the name of the current effect
     string CurrentEffectName() const override
     {
-        if (IsEffectSelected())
-            return _effects[_currentEffectIndex]->Name();
+        if (auto effect = CurrentEffect(*Snapshot()))
+            return effect->Name();
         return "No Effect Selected";
     }
 
@@ -158,9 +263,11 @@ public:
 
     void ClearEffects() override
     {
-        lock_guard lock(_effectsMutex);
-        _effects.clear();
-        _currentEffectIndex = -1;
+        EditEffects([&](EffectList &effects)
+        {
+            effects.clear();
+            _currentEffectIndex = -1;
+        });
     }
 
 
@@ -179,147 +286,33 @@ public:
         return _running;
     }
 
-    // Start the worker thread to update effects
+    // Start
+    //
+    // Renders on the shared FrameScheduler when it's enabled, otherwise on a thread of our own
+    // that sleeps until each frame is due
 
     void Start(ICanvas &canvas) override
     {
-        logger->debug("Starting effects manager with {} effects at {} FPS", _effects.size(), _fps);
+        logger->debug("Starting effects manager with {} effects at {} FPS", EffectCount(), _fps);
 
         if (_running.exchange(true))
             return; // Already running
 
-        _workerThread = thread([this, &canvas]()
+        if (FrameScheduler::Instance().IsEnabled())
         {
-            const auto effectiveFps = max<uint16_t>(1, _fps);
-            // Computed via a double-precision intermediate rather than truncating
-            // nanoseconds(1'000'000'000LL / fps) up front, so FPS values that don't
-            // divide evenly into a second don't bias the frame clock low every frame.
-            const auto frameDuration = duration_cast<steady_clock::duration>(duration<double>(1.0 / effectiveFps));
-            // next two non-const because we may need to reset them if we fall behind
-            auto startTimeSteady = steady_clock::now();
-            auto startTimeSystem = system_clock::now();
-
-            auto lastFrameTimeSteady = startTimeSteady;
-            auto lastHeartbeatTime = startTimeSteady;
-            auto lastScheduleCheck = startTimeSteady;
-            auto frameCount = 0LL;
+            StartFrameClock(canvas);
+            _scheduledId = FrameScheduler::Instance().Schedule([this, &canvas] { return RenderFrame(canvas); });
+            return;
+        }
 
-            {
-                lock_guard lock(_effectsMutex);
-                StartCurrentEffect(canvas);
-            }
+        _workerThread = thread([this, &canvas]()
+        {
+            StartFrameClock(canvas);
 
             while (_running)
             {
-                auto now = steady_clock::now();
-
-                // When an effect is active, we check every frame.
-                // When no effect is active, we check every 500ms to save CPU.
-                bool shouldCheckSchedule = _lastScheduleState || (now - lastScheduleCheck >= 500ms);
-
-                int activeIndex = -1;
-                if (shouldCheckSchedule)
-                {
-                    lastScheduleCheck = now;
-                    lock_guard lock(_effectsMutex);
-                    for (int i = 0; i < static_cast<int>(_effects.size()); ++i)
-                    {
-                        auto &effect = _effects[i];
-                        if (effect->GetSchedule() == nullptr || effect->GetSchedule()->IsActive())
-                        {
-                            activeIndex = i;
-                            break;
-                        }
-                    }
-                }
-                else
-                {
-                    // If we didn't check, assume the state hasn't changed from "inactive"
-                    activeIndex = -1;
-                }
-
-                // Calculate the actual target timestamp for this packet based on the wall clock
-                frameCount++;
-                auto nextFrameTimeSteady = startTimeSteady + (frameDuration * frameCount);
-                auto packetTimestamp = startTimeSystem + duration_cast<system_clock::duration>(frameDuration * frameCount);
-
-                if (activeIndex != -1)
-                {
-                    if (activeIndex != _currentEffectIndex)
-                    {
-                        lock_guard lock(_effectsMutex);
-                        logger->info("Switching to effect '{}' based on schedule.", _effects[activeIndex]->Name());
-                        _currentEffectIndex = activeIndex;
-                        _effects[_currentEffectIndex]->Start(canvas);
-                    }
-
-                    {
-                        lock_guard lock(_effectsMutex);
-                        auto delta = duration_cast<microseconds>(now - lastFrameTimeSteady);
-                        UpdateCurrentEffect(canvas, delta);
-                    }
-
-                    for (const auto &feature : canvas.Features())
-                    {
-                        auto frame = feature->GetDataFrame(time_point_cast<system_clock::duration>(packetTimestamp));
-                        feature->Socket()->EnqueueFrame(feature->Socket()->CompressFrame(frame));
-                    }
-                    _lastScheduleState = true;
-                    lastHeartbeatTime = now;
-                }
-                else
-                {
-                    if (_lastScheduleState || (now - lastHeartbeatTime) >= 2s) {
-                        {
-                            lock_guard lock(_effectsMutex);
-                            canvas.Graphics().Clear(CRGB::Black);
-                        }
-                        for (const auto &feature : canvas.Features())
-                        {
-                            auto frame = feature->GetDataFrame(time_point_cast<system_clock::duration>(packetTimestamp));
-                            feature->Socket()->EnqueueFrame(feature->Socket()->CompressFrame(frame));
-                        }
-
-                        if (_lastScheduleState)
-                            logger->info("No scheduled effects are active for canvas '{}'. Sending heartbeats.", canvas.Name());
-
-                        _lastScheduleState = false;
-                        lastHeartbeatTime = now;
-                    }
-                }
-
-                lastFrameTimeSteady = now;
-
-                // Drift detection and re-sync
-                auto actualTime = system_clock::now();
-                auto drift = duration_cast<microseconds>(packetTimestamp - actualTime).count();
-                if (abs(drift) > 200000) // 200ms in microseconds
-                {
-                    logger->debug("Canvas '{}' clock drift detected: {}us. Re-syncing.", canvas.Name(), drift);
-                    // To re-sync, we'd need to adjust startTimeSystem or frameCount,
-                    // but for now we just log it as it should be much rarer now.
-                }
-
-                // Avoid a bursty catch-up (sending queued-up frames back-to-back as fast as
-                // possible) if rendering or socket work falls more than a frame behind: jump
-                // the frame counter forward to match real elapsed time instead of stepping
-                // through every missed frame.
-                if (now > nextFrameTimeSteady + frameDuration)
-                {
-                    auto elapsedTicks = duration_cast<steady_clock::duration>(now - startTimeSteady).count();
-                    auto frameTicks = frameDuration.count();
-                    frameCount = elapsedTicks / frameTicks + 1;
-                }
-
-                if (nextFrameTimeSteady < now - 1s) // Sane reset
-                {
-                    logger->warn("Canvas '{}' fell behind by >1s, resetting frame clock.", canvas.Name());
-                    frameCount = 0;
-                    startTimeSteady = now;
-                    startTimeSystem = system_clock::now();
-                }
-
-                if (nextFrameTimeSteady > now)
+                auto nextFrameTimeSteady = RenderFrame(canvas);
+                if (nextFrameTimeSteady > steady_clock::now())
                     this_thread::sleep_until(nextFrameTimeSteady);
             }
         });
@@ -332,17 +325,34 @@ public:
         if (!_running.exchange(false))
             return; // Not running
 
+        if (_scheduledId)
+        {
+            FrameScheduler::Instance().Unschedule(_scheduledId);
+            _scheduledId = 0;
+        }
+
         if (_workerThread.joinable())
             _workerThread.join();
+
+        try
+        {
+            FinishSending();
+        }
+        catch (const exception &e)
+        {
+            logger->warn("Last frame failed to send while stopping: {}", e.what());
+        }
     }
 
     void SetEffects(vector<shared_ptr<ILEDEffect>> effects) override
     {
-        lock_guard lock(_effectsMutex);
-        _effects = std::move(effects);
+        EditEffects([&](EffectList &current)
+        {
+            current = std::move(effects);
 
-        if (_currentEffectIndex == -1 && !_effects.empty())
-            _currentEffectIndex = 0;
+            if (_currentEffectIndex == -1 && !current.empty())
+                _currentEffectIndex = 0;
+        });
     }
 
     void SetCurrentEffectIndex(int index) override
@@ -351,9 +361,253 @@ public:
     }
 
 private:
-    bool IsEffectSelected() const
+    void StartFrameClock(ICanvas &canvas)
+    {
+        const auto effectiveFps = max<uint16_t>(1, _fps);
+        // Computed via a double-precision intermediate rather than truncating
+        // nanoseconds(1'000'000'000LL / fps) up front, so FPS values that don't
+        // divide evenly into a second don't bias the frame clock low every frame.
+        _clock.frameDuration = duration_cast<steady_clock::duration>(duration<double>(1.0 / effectiveFps));
+        _clock.startTimeSteady = steady_clock::now();
+        _clock.startTimeSystem = system_clock::now();
+
+        _clock.lastFrameTimeSteady = _clock.startTimeSteady;
+        _clock.lastFrameTarget = _clock.startTimeSteady;
+        _clock.lastHeartbeatTime = _clock.startTimeSteady;
+        _clock.frameCount = 0;
+        _clock.scheduledEffects = nullptr;
+        _clock.renderedEffect = nullptr;
+        _clock.transition.reset();
+
+        StartCurrentEffect(canvas);
+    }
+
+    // RenderFrame
+    //
+    // Renders and sends one frame and returns when the next one is due.  A time in the past
+    // means we're behind and the next frame should follow immediately.
+
+    steady_clock::time_point RenderFrame(ICanvas &canvas)
+    {
+        auto &frameDuration = _clock.frameDuration;
+        auto now = steady_clock::now();
+
+        // One snapshot of the effects for the whole frame; edits made meanwhile show up next frame
+        auto effects = Snapshot();
+
+        // Which effect the schedules pick can only change at a schedule boundary or when the
+        // effects are edited, so they're only evaluated then
+        if (effects != _clock.scheduledEffects || system_clock::now() >= _clock.nextScheduleCheck)
+            EvaluateSchedules(effects);
+
+        int activeIndex = _clock.activeIndex;
+
+        // Calculate the actual target timestamp for this packet based on the wall clock
+        _clock.frameCount++;
+        auto nextFrameTimeSteady = _clock.startTimeSteady + (frameDuration * _clock.frameCount);
+        auto packetTimestamp = _clock.startTimeSystem + duration_cast<system_clock::duration>(frameDuration * _clock.frameCount);
+        auto lead = steady_clock::duration::zero();
+
+        if (activeIndex != -1)
+        {
+            auto &effect = (*effects)[activeIndex];
+            if (effect != _clock.renderedEffect)
+                BeginTransition(canvas, effect);
+
+            if (activeIndex != _currentEffectIndex)
+            {
+                logger->info("Switching to effect '{}' based on schedule.", effect->Name());
+                _currentEffectIndex = activeIndex;
+                effect->Start(canvas);
+            }
+
+            lead = RenderAheadLead(canvas, *effect);
+
+            // Frames rendered ahead in a burst are only microseconds apart in real time, so
+            // the effect is advanced by the time between the frames' display times instead
+            auto delta = lead > steady_clock::duration::zero()
+                ? duration_cast<microseconds>(nextFrameTimeSteady - _clock.lastFrameTarget)
+                : duration_cast<microseconds>(now - _clock.lastFrameTimeSteady);
+            if (_clock.transition)
+            {
+                _clock.transition->Render(canvas, *effect, delta, frameDuration);
+                if (_clock.transition->IsDone())
+                    _clock.transition.reset();
+            }
+            else
+            {
+                effect->Update(canvas, delta);
+            }
+
+            PresentAndSend(canvas, time_point_cast<system_clock::duration>(packetTimestamp));
+            _lastScheduleState = true;
+            _clock.lastHeartbeatTime = now;
+        }
+        else
+        {
+            _clock.renderedEffect = nullptr;
+            _clock.transition.reset();
+
+            if (_lastScheduleState || (now - _clock.lastHeartbeatTime) >= 2s) {
+                canvas.Graphics().Clear(CRGB::Black);
+                PresentAndSend(canvas, time_point_cast<system_clock::duration>(packetTimestamp));
+
+                if (_lastScheduleState)
+                    logger->info("No scheduled effects are active for canvas '{}'. Sending heartbeats.", canvas.Name());
+
+                _lastScheduleState = false;
+                _clock.lastHeartbeatTime = now;
+            }
+        }
+
+        _clock.lastFrameTimeSteady = now;
+        _clock.lastFrameTarget = nextFrameTimeSteady;
+
+        // Drift detection and re-sync
+        auto actualTime = system_clock::now();
+        auto drift = duration_cast<microseconds>(packetTimestamp - actualTime - lead).count();
+        if (abs(drift) > 200000) // 200ms in microseconds
+        {
+            logger->debug("Canvas '{}' clock drift detected: {}us. Re-syncing.", canvas.Name(), drift);
+            // To re-sync, we'd need to adjust startTimeSystem or frameCount,
+            // but for now we just log it as it should be much rarer now.
+        }
+
+        // Avoid a bursty catch-up (sending queued-up frames back-to-back as fast as
+        // possible) if rendering or socket work falls more than a frame behind: jump
+        // the frame counter forward to match real elapsed time instead of stepping
+        // through every missed frame.
+        if (now > nextFrameTimeSteady + frameDuration)
+        {
+            auto elapsedTicks = duration_cast<steady_clock::duration>(now - _clock.startTimeSteady).count();
+            auto frameTicks = frameDuration.count();
+            _clock.frameCount = elapsedTicks / frameTicks + 1;
+        }
+
+        if (nextFrameTimeSteady < now - 1s) // Sane reset
+        {
+            logger->warn("Canvas '{}' fell behind by >1s, resetting frame clock.", canvas.Name());
+            _clock.frameCount = 0;
+            _clock.startTimeSteady = now;
+            _clock.startTimeSystem = system_clock::now();
+            _clock.lastFrameTarget = now;
+        }
+
+        // Rendering ahead, keep going until the lead is full and then sleep off half of it
+
+        if (lead > steady_clock::duration::zero())
+            return nextFrameTimeSteady - now < lead ? now : time_point_cast<steady_clock::duration>(nextFrameTimeSteady - lead / 2);
+
+        return nextFrameTimeSteady;
+    }
+
+    // EvaluateSchedules
+    //
+    // Picks the first effect whose schedule is active and works out when that could next change:
+    // the earliest boundary of that effect or any before it, since those would take precedence
+
+    void EvaluateSchedules(const shared_ptr<const EffectList> &effects)
+    {
+        auto now = system_clock::now();
+        auto next = now + kMaxScheduleRecheck;
+        int activeIndex = -1;
+
+        for (int i = 0; i < static_cast<int>(effects->size()); ++i)
+        {
+            auto schedule = (*effects)[i]->GetSchedule();
+            if (schedule == nullptr || schedule->IsActiveAt(now))
+            {
+                activeIndex = i;
+                if (schedule)
+                    next = min(next, schedule->NextTransition(now));
+                break;
+            }
+            next = min(next, schedule->NextTransition(now));
+        }
+
+        _clock.scheduledEffects = effects;
+        _clock.activeIndex = activeIndex;
+        _clock.nextScheduleCheck = next;
+    }
+
+    // BeginTransition
+    //
+    // Called when the effect to show isn't the one the previous frame showed.  A transition that
+    // was already running is cut short, and the new one starts from whatever is on the canvas.
+
+    void BeginTransition(ICanvas &canvas, const shared_ptr<ILEDEffect> &effect)
+    {
+        _clock.transition.reset();
+
+        if (_clock.renderedEffect && _transitionType != TransitionType::Cut && _transitionDuration > 0ms)
+            _clock.transition.emplace(_transitionType, _transitionDuration, _clock.renderedEffect, canvas.Graphics());
+
+        _clock.renderedEffect = effect;
+    }
+
+    // RenderAheadLead
+    //
+    // How far ahead of time the effect may be rendered.  A client can only hold so many frames,
+    // so the lead is capped at what the smallest client buffer on the canvas has room for.
+
+    steady_clock::duration RenderAheadLead(ICanvas &canvas, const ILEDEffect &effect) const
+    {
+        if (_renderAhead == 0ms || !effect.IsDeterministic() || (_clock.transition && !_clock.transition->IsDeterministic()))
+            return steady_clock::duration::zero();
+
+        steady_clock::duration lead = _renderAhead;
+        for (const auto &feature : canvas.Features())
+            lead = min(lead, _clock.frameDuration * feature->ClientBufferCount());
+        return lead;
+    }
+
+    // PresentAndSend
+    //
+    // Publishes what the effect drew and sends it.  The previous frame may still be encoding
+    // from the front buffer, so it has to finish before the front buffer is overwritten.
+
+    void PresentAndSend(ICanvas &canvas, system_clock::time_point timestamp)
+    {
+        FinishSending();
+        canvas.PresentFrame();
+
+        if (_pipelined)
+            _sending = WorkerPool::Instance().Post([&canvas, timestamp] { FeatureFrames::Send(canvas, timestamp); });
+        else
+            FeatureFrames::Send(canvas, timestamp);
+    }
+
+    void FinishSending()
+    {
+        if (_sending.valid())
+            _sending.get();
+    }
+
+    shared_ptr<const EffectList> Snapshot() const
+    {
+        return atomic_load(&_effects);
+    }
+
+    // EditEffects
+    //
+    // Applies edit to a copy of the effect list and publishes the copy.  Readers holding the old
+    // snapshot keep using it until they're done with it.
+
+    template<typename Edit>
+    void EditEffects(Edit edit)
+    {
+        lock_guard lock(_effectsMutex);
+        auto effects = make_shared<EffectList>(*Snapshot());
+        edit(*effects);
+        atomic_store(&_effects, shared_ptr<const EffectList>(std::move(effects)));
+    }
+
+    // The current effect in the given snapshot, or null if the index doesn't point into it
+
+    shared_ptr<ILEDEffect> CurrentEffect(const EffectList &effects) const
     {
-        return _currentEffectIndex >= 0 && _currentEffectIndex < static_cast<int>(_effects.size());
+        int index = _currentEffectIndex;
+        return index >= 0 && index < static_cast<int>(effects.size()) ? effects[index] : nullptr;
     }
 };
 
@@ -391,7 +645,8 @@ static const map<string, pair<EffectSerializer, EffectDeserializer>> to_from_jso
         jsonPair<StarfieldEffect>(),
         jsonPair<StockBanner>(),
         jsonPair<MP4PlaybackEffect>(),
-        jsonPair<AuroraEffect>()
+        jsonPair<AuroraEffect>(),
+        jsonPair<LayeredEffect>()
 };
 
 // Dynamically serialize an effect to JSON based on its actual type
@@ -459,6 +714,10 @@ inline void to_json(nlohmann::json &j, const IEffectsManager &manager)
     j =
     {
         {"fps", manager.GetFPS()},
+        {"pipelined", manager.IsPipelined()},
+        {"renderAheadMs", manager.GetRenderAhead().count()},
+        {"transition", manager.GetTransitionType()},
+        {"transitionMs", manager.GetTransitionDuration().count()},
         {"currentEffectIndex", currentEffectIndex},
         {"running", manager.IsRunning()}
     };
@@ -472,6 +731,9 @@ inline void to_json(nlohmann::json &j, const IEffectsManager &manager)
 inline void from_json(const nlohmann::json &j, IEffectsManager &manager)
 {
     manager.SetFPS(j.value("fps", uint16_t(30)));
+    manager.SetPipelined(j.value("pipelined", false));
+    manager.SetRenderAhead(milliseconds(j.value("renderAheadMs", 0)));
+    manager.SetTransition(j.value("transition", TransitionType::Cut), milliseconds(j.value("transitionMs", 0)));
 
     if (j.contains("effects"))
         manager.SetEffects(j.at("effects").get<vector<shared_ptr<ILEDEffect>>>());
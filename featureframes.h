@@ -0,0 +1,135 @@
+#pragma once
+using namespace std;
+using namespace chrono;
+
+// FeatureFrames
+//
+// Builds and queues a frame for every feature on a canvas.  Features that cover the same part
+// of the canvas with the same settings produce identical frames, so they're grouped and each
+// group's frame is built and hashed once and, if any of their channels wants it, compressed
+// once, with every feature's channel queuing the same buffer.  Features in a group whose
+// channels send UDP to the same host and port (typically a multicast group that several
+// clients listen on) only need that frame sent once, so only the first of them sends it.
+//
+// Groups don't share anything, so they're encoded in parallel on the WorkerPool when it has
+// threads; either way every frame has been queued by the time Send returns.
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "interfaces.h"
+#include "framepool.h"
+#include "framecodec.h"
+#include "utilities.h"
+#include "workerpool.h"
+
+class FeatureFrames
+{
+public:
+    using Group = vector<shared_ptr<ILEDFeature>>;
+
+    static void Send(ICanvas &canvas, system_clock::time_point timestamp)
+    {
+        auto groups = GroupFeatures(canvas.Features());
+
+        WorkerPool::Instance().ParallelFor(groups.size(), [&](size_t index)
+        {
+            SendGroup(groups[index], timestamp);
+        });
+    }
+
+    // GroupFeatures
+    //
+    // Splits features into the groups that send the same frame.  A UDP destination is only
+    // left out when another feature of the same group already sends to it; features that send
+    // different frames to one host and port, like the channels of a single controller, all
+    // keep their own.
+
+    static vector<Group> GroupFeatures(const vector<shared_ptr<ILEDFeature>> &features)
+    {
+        vector<Group> groups;
+        vector<vector<pair<string, uint16_t>>> udpDestinations;
+
+        for (const auto &feature : features)
+        {
+            auto group = find_if(groups.begin(), groups.end(), [&](const Group &candidate)
+            {
+                return SendsSameFrame(*candidate.front(), *feature);
+            });
+
+            if (group == groups.end())
+            {
+                groups.emplace_back();
+                udpDestinations.emplace_back();
+                group = groups.end() - 1;
+            }
+
+            auto socket = feature->Socket();
+            if (socket->Transport() == SocketTransport::Udp)
+            {
+                auto &destinations = udpDestinations[group - groups.begin()];
+                auto destination = make_pair(socket->HostName(), socket->Port());
+                if (find(destinations.begin(), destinations.end(), destination) != destinations.end())
+                    continue;
+                destinations.push_back(std::move(destination));
+            }
+
+            group->push_back(feature);
+        }
+
+        return groups;
+    }
+
+    // SendGroup
+    //
+    // The pixel hash lets a channel that skips unchanged frames decline the frame before any
+    // compression happens, and lets the encoder reuse compressed pixels when they repeat.
+    // Each feature is charged for building the frame plus its own compressing and queueing.
+
+    static void SendGroup(const Group &features, system_clock::time_point timestamp)
+    {
+        auto buildStart = steady_clock::now();
+
+        const auto &first = *features.front();
+        auto data = FramePool::Instance().Acquire(first.DataFrameSize());
+        first.WriteDataFrame(timestamp, data->data());
+
+        size_t headerSize = data->size() - static_cast<size_t>(first.Width()) * first.Height() * sizeof(CRGB);
+        uint64_t pixelHash = Utilities::HashBytes(data->data() + headerSize, data->size() - headerSize);
+
+        auto buildTime = steady_clock::now() - buildStart;
+
+        FramePtr frame;
+        for (const auto &feature : features)
+        {
+            auto start = steady_clock::now();
+            auto socket = feature->Socket();
+
+            if (socket->ShouldSendFrame(pixelHash))
+            {
+                if (!frame)
+                    frame = socket->CompressFrame(data->data(), data->size(), headerSize, pixelHash);
+                socket->EnqueueFrame(frame, timestamp);
+            }
+
+            socket->RecordEncodeTime(duration_cast<nanoseconds>(buildTime + (steady_clock::now() - start)));
+        }
+    }
+
+    // Frames from a codec that depends on what the channel sent before are never shared
+
+    static bool SendsSameFrame(const ILEDFeature &a, const ILEDFeature &b)
+    {
+        auto codec = a.Socket()->GetCodec();
+
+        return a.Width() == b.Width() && a.Height() == b.Height()
+            && a.OffsetX() == b.OffsetX() && a.OffsetY() == b.OffsetY()
+            && a.Reversed() == b.Reversed() && a.Channel() == b.Channel()
+            && a.RedGreenSwap() == b.RedGreenSwap() && a.TimeOffset() == b.TimeOffset()
+            && a.OutputTransform() == b.OutputTransform()
+            && codec == b.Socket()->GetCodec() && !FrameEncoder::IsStateful(codec)
+            && a.Socket()->GetCompressionLevel() == b.Socket()->GetCompressionLevel();
+    }
+};
@@ -0,0 +1,113 @@
+#pragma once
+using namespace std;
+using namespace chrono;
+
+// FlowController
+//
+// Paces the frames a SocketChannel sends by how far ahead of its client it is.  Every client
+// response reports how many frames the client has buffered (bufferPos) out of how many it can
+// hold (bufferSize); together with the frames still waiting in our own queue, that's how many
+// frames we're ahead.  The controller tries to keep that at a target fraction of the client's
+// buffer.
+//
+// It does so by adjusting a send ratio, the fraction of rendered frames that actually get sent.
+// When we're further ahead than the target, the ratio is cut multiplicatively; when we're
+// behind, it grows additively back toward sending every frame.  A client that can't keep up
+// thus ends up with a lower frame rate instead of an overflowing buffer or a full queue.
+//
+// Responses arrive on the channel's consumer thread and frames are admitted on the producer
+// thread, so the two only share atomics.
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+class FlowController
+{
+public:
+    static constexpr double kDefaultTargetFill = 0.5;
+    static constexpr double kMinSendRatio      = 0.1;     // Never drop below 1 in 10 frames
+    static constexpr double kIncreaseStep      = 0.05;
+    static constexpr double kDecreaseFactor    = 0.8;
+    static constexpr double kHysteresis        = 0.1;     // Dead band around the target
+    static constexpr auto   kUpdateInterval    = 250ms;
+
+private:
+    atomic<bool>   _enabled{false};
+    atomic<double> _targetFill{kDefaultTargetFill};
+    atomic<double> _sendRatio{1.0};
+    atomic<double> _lastFill{0.0};
+
+    double _credit = 0.0;                       // Producer only
+    steady_clock::time_point _lastUpdate;       // Consumer only
+
+public:
+    void Configure(bool enabled, double targetFill)
+    {
+        _targetFill = clamp(targetFill, 0.05, 1.0);
+        _enabled = enabled;
+        if (!enabled)
+            _sendRatio = 1.0;
+    }
+
+    bool   IsEnabled()  const { return _enabled; }
+    double TargetFill() const { return _targetFill; }
+    double SendRatio()  const { return _sendRatio; }
+    double LastFill()   const { return _lastFill; }
+
+    // Reset
+    //
+    // Called when the connection is (re)established; we know nothing about the new client yet
+
+    void Reset()
+    {
+        _sendRatio = 1.0;
+        _lastFill = 0.0;
+        _lastUpdate = steady_clock::time_point();
+    }
+
+    // OnClientResponse
+    //
+    // Feeds the controller a client response.  Updates are rate limited so that the burst of
+    // responses a client sends while catching up only counts once.
+
+    void OnClientResponse(uint32_t bufferPos, uint32_t bufferSize, size_t queuedFrames, steady_clock::time_point now = steady_clock::now())
+    {
+        if (!_enabled || bufferSize == 0)
+            return;
+
+        if (now - _lastUpdate < kUpdateInterval)
+            return;
+        _lastUpdate = now;
+
+        double fill = (static_cast<double>(bufferPos) + queuedFrames) / bufferSize;
+        _lastFill = fill;
+
+        double ratio = _sendRatio;
+        if (fill > _targetFill + kHysteresis)
+            ratio *= kDecreaseFactor;
+        else if (fill < _targetFill - kHysteresis)
+            ratio += kIncreaseStep;
+
+        _sendRatio = clamp(ratio, kMinSendRatio, 1.0);
+    }
+
+    // Admit
+    //
+    // Called by the producer for every rendered frame; returns whether this one should be sent.
+    // Spreads the admitted frames evenly rather than sending them in runs.
+
+    bool Admit()
+    {
+        if (!_enabled)
+            return true;
+
+        _credit = min(_credit + _sendRatio.load(), 2.0);
+        if (_credit < 1.0)
+            return false;
+
+        _credit -= 1.0;
+        return true;
+    }
+};
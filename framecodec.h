@@ -0,0 +1,442 @@
+#pragma once
+using namespace std;
+using namespace chrono;
+
+// FrameEncoder
+//
+// Turns data frames into what a socket channel actually queues, using one of the FrameCodecs.
+// Compressed frames carry a 16 byte header in front of the zlib data:
+//
+//      DWORD   tag             'DAVE' (0x44415645) for a compressed frame, or
+//                              'DELT' (0x44454C54) for a delta frame
+//      DWORD   compressedSize  Length of the zlib data that follows
+//      DWORD   originalSize    Length of the data frame once decompressed
+//      DWORD   custom          0x12345678 for a compressed frame; for a delta frame, the
+//                              Adler-32 checksum of the frame the delta applies to
+//
+// A compressed frame's zlib data is one stream, but when the pixels haven't changed since the
+// last frame it may be two deflate streams back to back: the frame header, ending in a full
+// flush, followed by the pixels.  That lets the encoder keep the compressed pixels and only
+// compress the header, whose timestamp changes every frame, when the same pixels come along
+// again.  Any zlib inflate decodes it like any other stream.
+//
+// A delta frame decompresses to the XOR of the new data frame and the previous one.  The
+// checksum lets a client that missed the previous frame notice and skip deltas until the next
+// keyframe, an ordinary compressed frame that's sent periodically and whenever the channel
+// knows a frame didn't make it.  Raw frames are the data frame itself, with no header.
+//
+// The encoder can also skip frames whose pixels haven't changed altogether, sending only an
+// occasional keepalive copy with a fresh timestamp so the client knows it's still connected.
+//
+// Each channel has its own encoder.  Encode is only called from the producer side, but the
+// settings and statistics can be read from anywhere.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <zlib.h>
+#include "interfaces.h"
+#include "utilities.h"
+#include "framepool.h"
+#include "framecompressor.h"
+
+class FrameEncoder
+{
+public:
+    static constexpr uint32_t CompressedTag = 0x44415645;       // 'DAVE'
+    static constexpr uint32_t DeltaTag = 0x44454C54;            // 'DELT'
+    static constexpr uint32_t CustomTag = 0x12345678;
+    static constexpr size_t HeaderSize = 16;
+
+    static constexpr size_t kKeyframeInterval = 120;            // Most delta frames in a row
+    static constexpr size_t kTrialInterval = 240;               // Frames between Auto measurements
+    static constexpr double kMinSavings = 0.1;                  // Compression has to save 10% to be used
+    static constexpr auto kDefaultKeepalive = 1000ms;
+
+private:
+    mutex _mutex;
+    atomic<FrameCodec> _codec = FrameCodec::Zlib;
+    atomic<FrameCodec> _activeCodec = FrameCodec::Zlib;
+    FrameCompressor _deflate;
+    FrameCompressor _rle{Z_BEST_SPEED, Z_RLE};
+
+    // Delta state
+
+    vector<uint8_t> _previous;
+    uLong _previousChecksum = 0;
+    vector<uint8_t> _delta;
+    size_t _framesSinceKeyframe = 0;
+    uint64_t _epoch = 0;
+
+    size_t _framesSinceTrial = 0;
+
+    // Unchanged pixel state.  _cachedPixels is the raw deflate data for the pixels with hash
+    // _pixelHash, compressed the second time they were seen.
+
+    uint64_t _pixelHash = 0;
+    int _cachedLevel = 0;
+    int _cachedStrategy = 0;
+    shared_ptr<vector<uint8_t>> _cachedPixels;
+    uLong _cachedPixelsChecksum = 0;
+    FrameCompressor _rawHeader{Z_BEST_SPEED, Z_DEFAULT_STRATEGY, true};
+    FrameCompressor _rawPixels{Z_BEST_SPEED, Z_DEFAULT_STRATEGY, true};
+
+    atomic<bool> _skipUnchanged = false;
+    atomic<milliseconds> _keepalive = kDefaultKeepalive;
+    uint64_t _lastSentHash = 0;
+    uint64_t _lastSentEpoch = 0;
+    steady_clock::time_point _lastSent;
+    atomic<uint64_t> _skippedFrames = 0;
+
+    atomic<uint64_t> _inputBytes = 0;
+    atomic<uint64_t> _outputBytes = 0;
+
+    atomic<double> _lastEncodeMicros = 0.0;
+    atomic<double> _averageEncodeMicros = 0.0;
+
+public:
+    void Configure(FrameCodec codec, int level)
+    {
+        lock_guard lock(_mutex);
+        _deflate.SetLevel(level);
+        _codec = codec;
+        _activeCodec = codec == FrameCodec::Auto ? FrameCodec::Zlib : codec;
+        _framesSinceTrial = 0;
+        _previous.clear();
+    }
+
+    void SetSkipUnchanged(bool enabled, milliseconds keepalive)
+    {
+        _keepalive = max(keepalive, milliseconds(1));
+        _skipUnchanged = enabled;
+    }
+
+    bool SkipUnchanged() const
+    {
+        return _skipUnchanged;
+    }
+
+    milliseconds Keepalive() const
+    {
+        return _keepalive;
+    }
+
+    uint64_t SkippedFrames() const
+    {
+        return _skippedFrames;
+    }
+
+    FrameCodec Codec() const
+    {
+        return _codec;
+    }
+
+    int Level() const
+    {
+        return _deflate.Level();
+    }
+
+    // ActiveCodec
+    //
+    // The codec frames are currently encoded with, which is only different from Codec when
+    // that is Auto
+
+    FrameCodec ActiveCodec() const
+    {
+        return _activeCodec;
+    }
+
+    // Ratio
+    //
+    // Bytes out over bytes in, across every frame encoded so far
+
+    double Ratio() const
+    {
+        auto input = _inputBytes.load();
+        return input ? static_cast<double>(_outputBytes.load()) / input : 1.0;
+    }
+
+    // RecordEncodeTime
+    //
+    // How long it took to produce and queue the latest frame for this channel, as measured by
+    // whoever drives the encoder.  The average is an exponential one over roughly 16 frames.
+
+    void RecordEncodeTime(nanoseconds elapsed)
+    {
+        double micros = elapsed.count() / 1000.0;
+        double average = _averageEncodeMicros;
+        _lastEncodeMicros = micros;
+        _averageEncodeMicros = average == 0.0 ? micros : average + (micros - average) / 16.0;
+    }
+
+    double LastEncodeMicros() const
+    {
+        return _lastEncodeMicros;
+    }
+
+    double AverageEncodeMicros() const
+    {
+        return _averageEncodeMicros;
+    }
+
+    // IsStateful
+    //
+    // Whether a codec's output depends on earlier frames, in which case one channel's frames
+    // can't be handed to another
+
+    static bool IsStateful(FrameCodec codec)
+    {
+        return codec == FrameCodec::Delta;
+    }
+
+    // ShouldEncode
+    //
+    // Whether a frame whose pixels have the given hash needs to be sent at all.  Unless
+    // skipping is enabled it always does; otherwise only if the pixels changed, the keepalive
+    // interval is up, or the epoch says the last frame may not have made it.
+
+    bool ShouldEncode(uint64_t pixelHash, uint64_t epoch, steady_clock::time_point now = steady_clock::now())
+    {
+        lock_guard lock(_mutex);
+
+        if (_skipUnchanged && pixelHash != 0 && pixelHash == _lastSentHash && epoch == _lastSentEpoch
+            && now - _lastSent < _keepalive.load())
+        {
+            _skippedFrames++;
+            return false;
+        }
+
+        _lastSentHash = pixelHash;
+        _lastSentEpoch = epoch;
+        _lastSent = now;
+        return true;
+    }
+
+    // Encode
+    //
+    // Encodes one data frame.  epoch is any number that changes whenever a frame the channel
+    // encoded may not have reached the client; a change forces the next delta to be a keyframe.
+    //
+    // If headerSize and pixelHash are given, the frame is headerSize bytes of header followed by
+    // pixels with that hash, and compressed pixels are reused when the hash repeats.
+
+    FramePtr Encode(const uint8_t * data, size_t size, uint64_t epoch = 0, size_t headerSize = 0, uint64_t pixelHash = 0)
+    {
+        lock_guard lock(_mutex);
+
+        if (headerSize == 0 || headerSize >= size)
+            pixelHash = 0;
+
+        FramePtr frame;
+        switch (_codec.load())
+        {
+            case FrameCodec::Raw:
+                frame = EncodeRaw(data, size);
+                break;
+
+            case FrameCodec::Rle:
+                frame = EncodeReusingPixels(_rle, data, size, headerSize, pixelHash);
+                break;
+
+            case FrameCodec::Delta:
+                frame = EncodeDelta(data, size, epoch);
+                break;
+
+            case FrameCodec::Auto:
+                frame = EncodeAuto(data, size, headerSize, pixelHash);
+                break;
+
+            case FrameCodec::Zlib:
+            default:
+                frame = EncodeReusingPixels(_deflate, data, size, headerSize, pixelHash);
+                break;
+        }
+
+        _inputBytes += size;
+        _outputBytes += frame->size();
+        return frame;
+    }
+
+    // EncodeCompressed
+    //
+    // Compresses a frame into a 'DAVE' frame.  The compressor leaves headroom for the header in
+    // front of the compressed data, so the header is written in place.
+
+    static FramePtr EncodeCompressed(FrameCompressor & compressor, const uint8_t * data, size_t size,
+                                     uint32_t tag = CompressedTag, uint32_t custom = CustomTag)
+    {
+        auto frame = compressor.Compress(data, size, HeaderSize);
+        auto compressedSize = frame->size() - HeaderSize;
+
+        auto out = Utilities::WriteBytes(frame->data(), Utilities::DWORDToBytes(tag));
+        out = Utilities::WriteBytes(out, Utilities::DWORDToBytes(static_cast<uint32_t>(compressedSize)));
+        out = Utilities::WriteBytes(out, Utilities::DWORDToBytes(static_cast<uint32_t>(size)));
+        Utilities::WriteBytes(out, Utilities::DWORDToBytes(custom));
+
+        return frame;
+    }
+
+private:
+    static FramePtr EncodeRaw(const uint8_t * data, size_t size)
+    {
+        auto frame = FramePool::Instance().Acquire(size);
+        memcpy(frame->data(), data, size);
+        return frame;
+    }
+
+    FramePtr EncodeDelta(const uint8_t * data, size_t size, uint64_t epoch)
+    {
+        bool keyframe = _previous.size() != size || epoch != _epoch || _framesSinceKeyframe >= kKeyframeInterval;
+        _epoch = epoch;
+
+        FramePtr frame;
+        if (keyframe)
+        {
+            frame = EncodeCompressed(_deflate, data, size);
+            _framesSinceKeyframe = 0;
+        }
+        else
+        {
+            _delta.resize(size);
+            for (size_t i = 0; i < size; i++)
+                _delta[i] = data[i] ^ _previous[i];
+
+            frame = EncodeCompressed(_deflate, _delta.data(), size, DeltaTag, static_cast<uint32_t>(_previousChecksum));
+            _framesSinceKeyframe++;
+        }
+
+        _previous.assign(data, data + size);
+        _previousChecksum = adler32(adler32(0, Z_NULL, 0), data, static_cast<uInt>(size));
+        return frame;
+    }
+
+    // EncodeAuto
+    //
+    // Every kTrialInterval frames, encodes the frame every way and keeps the cheapest: raw
+    // unless compression saves at least kMinSavings, and of the two compressed forms the
+    // smaller, unless the faster one is within kMinSavings of it.
+
+    FramePtr EncodeAuto(const uint8_t * data, size_t size, size_t headerSize, uint64_t pixelHash)
+    {
+        if (_framesSinceTrial++ % kTrialInterval != 0)
+        {
+            switch (_activeCodec.load())
+            {
+                case FrameCodec::Raw:
+                    return EncodeRaw(data, size);
+                case FrameCodec::Rle:
+                    return EncodeReusingPixels(_rle, data, size, headerSize, pixelHash);
+                default:
+                    return EncodeReusingPixels(_deflate, data, size, headerSize, pixelHash);
+            }
+        }
+
+        auto start = steady_clock::now();
+        auto deflated = EncodeCompressed(_deflate, data, size);
+        auto deflateTime = steady_clock::now() - start;
+
+        start = steady_clock::now();
+        auto rle = EncodeCompressed(_rle, data, size);
+        auto rleTime = steady_clock::now() - start;
+
+        const auto worthwhile = static_cast<size_t>(size * (1.0 - kMinSavings));
+
+        FramePtr best = deflated;
+        FrameCodec bestCodec = FrameCodec::Zlib;
+        if (rle->size() <= deflated->size() || (rleTime < deflateTime && rle->size() * (1.0 - kMinSavings) <= deflated->size()))
+        {
+            best = rle;
+            bestCodec = FrameCodec::Rle;
+        }
+
+        if (best->size() > worthwhile)
+        {
+            best = EncodeRaw(data, size);
+            bestCodec = FrameCodec::Raw;
+        }
+
+        _activeCodec = bestCodec;
+        return best;
+    }
+
+    // EncodeReusingPixels
+    //
+    // Compresses a frame normally the first time its pixels are seen.  If the same pixels come
+    // around again, they're compressed once more on their own and kept, and from then on only
+    // the header needs compressing.
+
+    FramePtr EncodeReusingPixels(FrameCompressor & compressor, const uint8_t * data, size_t size, size_t headerSize, uint64_t pixelHash)
+    {
+        if (pixelHash == 0)
+            return EncodeCompressed(compressor, data, size);
+
+        if (pixelHash != _pixelHash || compressor.Level() != _cachedLevel || compressor.Strategy() != _cachedStrategy)
+        {
+            _pixelHash = pixelHash;
+            _cachedLevel = compressor.Level();
+            _cachedStrategy = compressor.Strategy();
+            _cachedPixels.reset();
+            return EncodeCompressed(compressor, data, size);
+        }
+
+        const uint8_t * pixels = data + headerSize;
+        const size_t pixelsSize = size - headerSize;
+
+        if (!_cachedPixels)
+        {
+            _rawPixels.SetParameters(_cachedLevel, _cachedStrategy);
+            _cachedPixels = _rawPixels.Compress(pixels, pixelsSize);
+            _cachedPixelsChecksum = adler32(adler32(0, Z_NULL, 0), pixels, static_cast<uInt>(pixelsSize));
+        }
+
+        auto header = _rawHeader.Compress(data, headerSize, 0, Z_FULL_FLUSH);
+        auto checksum = adler32_combine(adler32(adler32(0, Z_NULL, 0), data, static_cast<uInt>(headerSize)),
+                                        _cachedPixelsChecksum, static_cast<z_off_t>(pixelsSize));
+
+        // A zlib stream is a two byte header, the deflate data, and the Adler-32 of everything
+        // uncompressed, most significant byte first
+
+        const size_t streamSize = 2 + header->size() + _cachedPixels->size() + 4;
+        auto frame = FramePool::Instance().Acquire(HeaderSize + streamSize);
+
+        auto out = Utilities::WriteBytes(frame->data(), Utilities::DWORDToBytes(CompressedTag));
+        out = Utilities::WriteBytes(out, Utilities::DWORDToBytes(static_cast<uint32_t>(streamSize)));
+        out = Utilities::WriteBytes(out, Utilities::DWORDToBytes(static_cast<uint32_t>(size)));
+        out = Utilities::WriteBytes(out, Utilities::DWORDToBytes(CustomTag));
+
+        const uint16_t zlibHeader = ZlibHeader(_cachedLevel, _cachedStrategy);
+        *out++ = static_cast<uint8_t>(zlibHeader >> 8);
+        *out++ = static_cast<uint8_t>(zlibHeader);
+
+        out = copy(header->begin(), header->end(), out);
+        out = copy(_cachedPixels->begin(), _cachedPixels->end(), out);
+
+        for (int shift = 24; shift >= 0; shift -= 8)
+            *out++ = static_cast<uint8_t>(checksum >> shift);
+
+        return frame;
+    }
+
+    // ZlibHeader
+    //
+    // The two byte zlib stream header deflate itself would write: a 32K window, the same
+    // compression level hint, and the check bits
+
+    static uint16_t ZlibHeader(int level, int strategy)
+    {
+        int levelFlags = 3;
+        if (strategy >= Z_HUFFMAN_ONLY || level < 2)
+            levelFlags = 0;
+        else if (level < 6)
+            levelFlags = 1;
+        else if (level == 6)
+            levelFlags = 2;
+
+        uint16_t header = static_cast<uint16_t>((0x78 << 8) | (levelFlags << 6));
+        return static_cast<uint16_t>(header + 31 - header % 31);
+    }
+};
@@ -0,0 +1,163 @@
+#pragma once
+using namespace std;
+
+// FrameCompressor
+//
+// Compresses frames with a zlib deflate stream that lives as long as the compressor does.
+// Setting up a stream with deflateInit allocates a few hundred KB of window and hash tables,
+// and tearing it down frees them again; doing that for every frame of every feature adds up
+// quickly.  deflateReset just rewinds the existing stream for the next frame.
+//
+// Output goes into a FramePool buffer sized with deflateBound up front, so a frame always
+// compresses in one deflate call without growing its buffer.
+//
+// Resetting a stream still clears its hash table, which at zlib's defaults is 64 KB - far more
+// work than compressing a short strip.  The window and hash table are therefore sized to the
+// frames being compressed: a window as large as the frame loses nothing, and any inflate
+// accepts streams with a smaller window than its own.
+//
+// Each channel's FrameEncoder owns its compressors, and a channel's frames are normally only
+// compressed on the thread of the canvas it belongs to; the mutex only matters if someone else
+// calls CompressFrame too.
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <zlib.h>
+#include "framepool.h"
+
+class FrameCompressor
+{
+    static constexpr int kMinWindowBits = 9;
+    static constexpr int kMaxWindowBits = MAX_WBITS;
+    static constexpr int kDefaultMemLevel = 8;
+
+    mutex _mutex;
+    z_stream _stream{};
+    atomic<int> _level;
+    atomic<int> _strategy;
+    const bool _raw;                            // Bare deflate data, without the zlib wrapper
+    int _windowBits = 0;                        // Zero until the stream is initialized
+
+public:
+    explicit FrameCompressor(int level = Z_BEST_SPEED, int strategy = Z_DEFAULT_STRATEGY, bool raw = false)
+        : _level(level), _strategy(strategy), _raw(raw)
+    {
+    }
+
+    ~FrameCompressor()
+    {
+        if (_windowBits)
+            deflateEnd(&_stream);
+    }
+
+    FrameCompressor(const FrameCompressor &) = delete;
+    FrameCompressor & operator=(const FrameCompressor &) = delete;
+
+    int Level() const
+    {
+        return _level;
+    }
+
+    int Strategy() const
+    {
+        return _strategy;
+    }
+
+    // SetParameters
+    //
+    // Takes effect with the next frame, which sets up the stream afresh
+
+    void SetParameters(int level, int strategy)
+    {
+        level = clamp(level, Z_BEST_SPEED, Z_BEST_COMPRESSION);
+
+        lock_guard lock(_mutex);
+        if (level == _level && strategy == _strategy)
+            return;
+
+        if (_windowBits)
+            deflateEnd(&_stream);
+        _windowBits = 0;
+        _level = level;
+        _strategy = strategy;
+    }
+
+    void SetLevel(int level)
+    {
+        SetParameters(level, _strategy);
+    }
+
+    // Compress
+    //
+    // Compresses size bytes of data into a pooled buffer, leaving the first headroom bytes of
+    // the buffer free for the caller's header.  The buffer comes back trimmed to headroom plus
+    // the compressed length.
+    //
+    // With Z_FULL_FLUSH instead of Z_FINISH the data is left open-ended, byte aligned and with
+    // no back references into it, so another stream's output can follow it directly.
+
+    shared_ptr<vector<uint8_t>> Compress(const uint8_t * data, size_t size, size_t headroom = 0, int flush = Z_FINISH)
+    {
+        constexpr size_t kFlushMarkerSize = 8;  // Room for the empty stored block a flush ends with
+
+        lock_guard lock(_mutex);
+
+        PrepareStream(size);
+
+        auto frame = FramePool::Instance().Acquire(headroom + deflateBound(&_stream, static_cast<uLong>(size)) + kFlushMarkerSize);
+
+        _stream.next_in = const_cast<Bytef *>(data);
+        _stream.avail_in = static_cast<uInt>(size);
+        _stream.next_out = frame->data() + headroom;
+        _stream.avail_out = static_cast<uInt>(frame->size() - headroom);
+
+        int result = deflate(&_stream, flush);
+        bool finished = flush == Z_FINISH ? result == Z_STREAM_END : result == Z_OK && _stream.avail_in == 0 && _stream.avail_out != 0;
+        if (!finished)
+            throw runtime_error("Error during zlib compression");
+
+        frame->resize(headroom + _stream.total_out);
+        return frame;
+    }
+
+    // WindowBits
+    //
+    // The smallest window that holds a whole frame of the given size
+
+    static int WindowBits(size_t size)
+    {
+        int bits = kMinWindowBits;
+        while (bits < kMaxWindowBits && (size_t(1) << bits) < size)
+            bits++;
+        return bits;
+    }
+
+private:
+    void PrepareStream(size_t size)
+    {
+        int windowBits = WindowBits(size);
+
+        if (windowBits == _windowBits)
+        {
+            if (deflateReset(&_stream) != Z_OK)
+                throw runtime_error("Failed to reset zlib compression");
+            return;
+        }
+
+        if (_windowBits)
+            deflateEnd(&_stream);
+        _windowBits = 0;
+
+        // zlib's default memLevel pairs a 15 bit hash with its 15 bit window; keep that ratio
+
+        int memLevel = max(1, kDefaultMemLevel - (kMaxWindowBits - windowBits));
+        if (deflateInit2(&_stream, _level, Z_DEFLATED, _raw ? -windowBits : windowBits, memLevel, _strategy) != Z_OK)
+            throw runtime_error("Failed to initialize zlib compression");
+        _windowBits = windowBits;
+    }
+};
@@ -0,0 +1,86 @@
+#pragma once
+using namespace std;
+
+// FramePool
+//
+// Recycles the byte buffers that frames are built in.  Every frame used to cost several heap
+// allocations on its way from the canvas to the socket; now the feature writes its header and
+// pixels straight into a pooled buffer, the channel compresses that into a second pooled
+// buffer that already has room for the compressed header, and the socket sends from it as is.
+//
+// Buffers are handed out as shared_ptrs whose deleter gives the buffer back to the pool, so
+// they can be queued on any number of channels and return once the last one has sent them.
+// A returned buffer keeps its capacity, and since frames for a given feature are the same size
+// every time, after the first few frames nothing on the send path allocates.
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include "interfaces.h"
+
+class FramePool
+{
+public:
+    static constexpr size_t kMaxPooledBuffers  = 1024;
+    static constexpr size_t kMaxPooledCapacity = 4 * 1024 * 1024;  // Let the odd huge frame go back to the heap
+
+private:
+    mutex _mutex;
+    vector<unique_ptr<vector<uint8_t>>> _free;
+
+    FramePool() = default;
+
+public:
+    // Instance
+    //
+    // Never destroyed, since buffers may still be queued on channels during static destruction
+
+    static FramePool & Instance()
+    {
+        static FramePool * instance = new FramePool();
+        return *instance;
+    }
+
+    // Acquire
+    //
+    // Returns a buffer of exactly size bytes.  Its contents are unspecified; the caller is
+    // expected to overwrite all of it.
+
+    shared_ptr<vector<uint8_t>> Acquire(size_t size)
+    {
+        unique_ptr<vector<uint8_t>> buffer;
+        {
+            lock_guard lock(_mutex);
+            if (!_free.empty())
+            {
+                buffer = std::move(_free.back());
+                _free.pop_back();
+            }
+        }
+
+        if (!buffer)
+            buffer = make_unique<vector<uint8_t>>();
+
+        buffer->resize(size);
+        return shared_ptr<vector<uint8_t>>(buffer.release(), [this](vector<uint8_t> * released) { Release(released); });
+    }
+
+    size_t Available()
+    {
+        lock_guard lock(_mutex);
+        return _free.size();
+    }
+
+private:
+    void Release(vector<uint8_t> * buffer)
+    {
+        unique_ptr<vector<uint8_t>> owned(buffer);
+        if (owned->capacity() > kMaxPooledCapacity)
+            return;
+
+        lock_guard lock(_mutex);
+        if (_free.size() < kMaxPooledBuffers)
+            _free.push_back(std::move(owned));
+    }
+};
@@ -0,0 +1,179 @@
+#pragma once
+using namespace std;
+
+// FrameRing
+//
+// A bounded, lock-free single-producer/single-consumer queue of frames.  A SocketChannel has
+// exactly one producer (the EffectsManager thread of the canvas its feature belongs to) and
+// exactly one consumer (the channel's worker thread or reactor loop), so the two sides only
+// ever need to agree on a pair of monotonically increasing counters.
+//
+// The ring owns a fixed set of slots, each holding a reference to an immutable frame.  Frames
+// are shared rather than copied, so neither Push nor Pop allocates, and features that send the
+// same data can all queue the one buffer.
+//
+// In addition to the slot count, the ring enforces a budget on the total number of queued
+// bytes.  Only the consumer may remove frames; anything that needs to drop queued frames on
+// behalf of the producer has to ask the consumer to do it.
+//
+// Each frame can carry a timestamp, which lets the consumer make decisions like skipping frames
+// that are already too late to be worth sending.
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include "interfaces.h"
+
+class FrameRing
+{
+    // Keep the producer and consumer counters on separate cache lines so the two threads
+    // don't invalidate each other's line on every operation
+
+    static constexpr size_t kCacheLine = 64;
+
+    vector<FramePtr> _slots;
+    vector<chrono::system_clock::time_point> _timestamps;
+    const size_t _maxBytes;
+
+    alignas(kCacheLine) atomic<uint64_t> _head{0};         // Next slot to pop; written by consumer
+    alignas(kCacheLine) atomic<uint64_t> _tail{0};         // Next slot to push; written by producer
+    alignas(kCacheLine) atomic<size_t>   _queuedBytes{0};
+
+public:
+    FrameRing(size_t capacity, size_t maxBytes)
+        : _slots(capacity), _timestamps(capacity), _maxBytes(maxBytes)
+    {
+        if (capacity == 0)
+            throw invalid_argument("FrameRing capacity must be greater than 0");
+    }
+
+    size_t Capacity() const
+    {
+        return _slots.size();
+    }
+
+    size_t MaxBytes() const
+    {
+        return _maxBytes;
+    }
+
+    // Size and QueuedBytes can be called from any thread, but are only a snapshot
+
+    size_t Size() const
+    {
+        return static_cast<size_t>(_tail.load(memory_order_acquire) - _head.load(memory_order_acquire));
+    }
+
+    bool Empty() const
+    {
+        return Size() == 0;
+    }
+
+    size_t QueuedBytes() const
+    {
+        return _queuedBytes.load(memory_order_relaxed);
+    }
+
+    // Producer side
+
+    // WouldFit
+    //
+    // Whether a frame of the given size could be pushed right now
+
+    bool WouldFit(size_t frameBytes) const
+    {
+        auto tail = _tail.load(memory_order_relaxed);
+        auto head = _head.load(memory_order_acquire);
+        return tail - head < _slots.size() && _queuedBytes.load(memory_order_relaxed) + frameBytes <= _maxBytes;
+    }
+
+    // TryPush
+    //
+    // Adds a reference to the frame to the ring.  On failure the ring is left untouched.
+
+    bool TryPush(FramePtr frame, chrono::system_clock::time_point timestamp = chrono::system_clock::time_point())
+    {
+        if (!frame || !WouldFit(frame->size()))
+            return false;
+
+        auto tail = _tail.load(memory_order_relaxed);
+        const size_t bytes = frame->size();
+
+        _timestamps[tail % _slots.size()] = timestamp;
+        _slots[tail % _slots.size()] = std::move(frame);
+
+        _queuedBytes.fetch_add(bytes, memory_order_relaxed);
+        _tail.store(tail + 1, memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+
+    // Peek
+    //
+    // Returns the frame at the given position from the front of the queue, or nullptr if there
+    // aren't that many.  The frame stays valid until it's popped.
+
+    const vector<uint8_t> * Peek(size_t index = 0) const
+    {
+        auto head = _head.load(memory_order_relaxed);
+        auto tail = _tail.load(memory_order_acquire);
+        if (tail - head <= index)
+            return nullptr;
+
+        return _slots[(head + index) % _slots.size()].get();
+    }
+
+    // Timestamp
+    //
+    // The timestamp of a frame returned by Peek with the same index
+
+    chrono::system_clock::time_point Timestamp(size_t index = 0) const
+    {
+        return _timestamps[(_head.load(memory_order_relaxed) + index) % _slots.size()];
+    }
+
+    void Pop()
+    {
+        auto head = _head.load(memory_order_relaxed);
+        auto & slot = _slots[head % _slots.size()];
+
+        _queuedBytes.fetch_sub(slot->size(), memory_order_relaxed);
+        slot.reset();
+        _head.store(head + 1, memory_order_release);
+    }
+
+    // TryPop
+    //
+    // Moves the reference to the front frame into frame
+
+    bool TryPop(FramePtr & frame)
+    {
+        if (!Peek())
+            return false;
+
+        auto head = _head.load(memory_order_relaxed);
+        frame = std::move(_slots[head % _slots.size()]);
+
+        _queuedBytes.fetch_sub(frame->size(), memory_order_relaxed);
+        _head.store(head + 1, memory_order_release);
+        return true;
+    }
+
+    // Clear
+    //
+    // Drops everything currently queued.  Returns the number of frames dropped.
+
+    size_t Clear()
+    {
+        size_t count = 0;
+        while (Peek())
+        {
+            Pop();
+            count++;
+        }
+        return count;
+    }
+};
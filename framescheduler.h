@@ -0,0 +1,212 @@
+#pragma once
+using namespace std;
+using namespace chrono;
+
+// FrameScheduler
+//
+// An alternative to giving every canvas its own render thread.  Each scheduled canvas
+// registers a step function that renders and sends one frame and returns the steady-clock
+// time its next frame is due.  The due times sit in one priority queue, and a fixed set of
+// worker threads takes whichever canvas is due first, so 40 canvases at mixed frame rates
+// need only as many threads as there are cores.
+//
+// A canvas is never stepped by two workers at once: it is taken out of the queue while its
+// step runs and only put back with the deadline the step returned.  A deadline that has
+// already passed makes the canvas due again straight away, which is how the frame clock's
+// own catch-up and reset logic keeps working unchanged.
+//
+// Only one idle worker at a time sleeps until the earliest deadline; the rest wait until
+// there is work for them, so a deadline wakes one thread rather than all of them.
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "global.h"
+
+class FrameScheduler
+{
+public:
+    using Step = function<steady_clock::time_point()>;
+
+private:
+    struct Deadline
+    {
+        steady_clock::time_point when;
+        uint64_t id;
+
+        bool operator>(const Deadline &other) const
+        {
+            return when > other.when;
+        }
+    };
+
+    mutable mutex _mutex;
+    condition_variable _timer;                  // The one worker waiting for the next deadline
+    condition_variable _idle;                   // Workers with nothing to do
+    condition_variable _stepped;                // Signalled whenever a step finishes
+    priority_queue<Deadline, vector<Deadline>, greater<>> _deadlines;
+    unordered_map<uint64_t, shared_ptr<const Step>> _entries;
+    unordered_set<uint64_t> _stepping;
+    size_t _workers = 0;                        // Detached, since they're never retired
+    size_t _threadCount = 0;
+    uint64_t _nextId = 1;
+    bool _timing = false;
+
+    FrameScheduler() = default;
+
+public:
+    // Instance
+    //
+    // Never destroyed, like the other process-wide singletons, since its workers may still be
+    // rendering during static destruction
+
+    static FrameScheduler & Instance()
+    {
+        static FrameScheduler * instance = new FrameScheduler();
+        return *instance;
+    }
+
+    // SetThreadCount
+    //
+    // Zero (the default) leaves canvases on their own threads.  Changing the count only affects
+    // canvases started afterwards, and workers are never retired, so canvases that are already
+    // scheduled keep being served until they are stopped.
+
+    void SetThreadCount(size_t count)
+    {
+        lock_guard lock(_mutex);
+        _threadCount = count;
+    }
+
+    size_t ThreadCount() const
+    {
+        lock_guard lock(_mutex);
+        return _threadCount;
+    }
+
+    bool IsEnabled() const
+    {
+        return ThreadCount() > 0;
+    }
+
+    // Schedule
+    //
+    // Runs step as soon as a worker is free and from then on whenever the time it last returned
+    // comes around.  Returns an id for Unschedule.
+
+    uint64_t Schedule(Step step)
+    {
+        lock_guard lock(_mutex);
+        if (_threadCount == 0)
+            throw runtime_error("Frame scheduler is not enabled");
+
+        for (; _workers < _threadCount; _workers++)
+            thread(&FrameScheduler::WorkerLoop, this).detach();
+
+        auto id = _nextId++;
+        _entries.emplace(id, make_shared<const Step>(std::move(step)));
+        Push({ steady_clock::now(), id });
+        return id;
+    }
+
+    // Unschedule
+    //
+    // Stops stepping id and waits for a step that is already running to finish, so the caller
+    // can tear down whatever the step uses.  Must not be called from the step itself.
+
+    void Unschedule(uint64_t id)
+    {
+        unique_lock lock(_mutex);
+        _entries.erase(id);
+        _stepped.wait(lock, [&] { return !_stepping.contains(id); });
+    }
+
+    size_t ScheduledCount() const
+    {
+        lock_guard lock(_mutex);
+        return _entries.size();
+    }
+
+private:
+    // Push
+    //
+    // Queues a deadline and wakes whoever needs to know: the timing worker if this is now the
+    // earliest deadline, or an idle worker if nobody is timing yet.  Caller holds _mutex.
+
+    void Push(Deadline deadline)
+    {
+        bool earliest = _deadlines.empty() || deadline.when < _deadlines.top().when;
+        _deadlines.push(deadline);
+
+        if (!_timing)
+            _idle.notify_one();
+        else if (earliest)
+            _timer.notify_one();
+    }
+
+    void WorkerLoop()
+    {
+        unique_lock lock(_mutex);
+
+        while (true)
+        {
+            // Deadlines of canvases that have been unscheduled are dropped as they surface
+
+            while (!_deadlines.empty() && !_entries.contains(_deadlines.top().id))
+                _deadlines.pop();
+
+            if (_deadlines.empty() || _timing)
+            {
+                _idle.wait(lock);
+                continue;
+            }
+
+            auto next = _deadlines.top();
+            if (next.when > steady_clock::now())
+            {
+                _timing = true;
+                _timer.wait_until(lock, next.when);
+                _timing = false;
+                continue;
+            }
+
+            _deadlines.pop();
+            auto step = _entries.at(next.id);
+            _stepping.insert(next.id);
+
+            // Someone else takes over waiting for the next deadline while we work
+
+            if (!_deadlines.empty())
+                _idle.notify_one();
+
+            lock.unlock();
+
+            optional<steady_clock::time_point> due;
+            try
+            {
+                due = (*step)();
+            }
+            catch (const exception &e)
+            {
+                logger->error("Scheduled frame failed, no longer rendering it: {}", e.what());
+            }
+
+            lock.lock();
+            _stepping.erase(next.id);
+            _stepped.notify_all();
+
+            if (!due)
+                _entries.erase(next.id);
+            else if (_entries.contains(next.id))
+                Push({ *due, next.id });
+        }
+    }
+};
@@ -0,0 +1,180 @@
+#pragma once
+using namespace std;
+using namespace chrono;
+
+// HostResolver
+//
+// Resolves client host names to IPv4 addresses without ever blocking the caller.  Dotted IP
+// addresses are handled inline; anything else is looked up by a small pool of background
+// threads, since getaddrinfo can block for many seconds when DNS is slow or unreachable.
+//
+// A lookup of a name we haven't resolved yet returns Pending and queues the name; the caller
+// is expected to ask again later.  Results are cached, successes for longer than failures.
+// Once a cached address expires it keeps being returned while a fresh lookup runs in the
+// background, so a flaky DNS server can't take down clients that were working.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <cstring>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "global.h"
+
+class HostResolver
+{
+public:
+    enum class Status
+    {
+        Resolved,
+        Pending,
+        Failed
+    };
+
+    static constexpr auto kPositiveTtl = 300s;
+    static constexpr auto kNegativeTtl = 15s;
+    static constexpr size_t kWorkerCount = 4;
+
+private:
+    struct Entry
+    {
+        bool hasAddress = false;
+        in_addr address{};
+        string error;
+        steady_clock::time_point expires;
+        bool lookupQueued = false;
+    };
+
+    mutex _mutex;
+    condition_variable _workAvailable;
+    unordered_map<string, Entry> _cache;
+    deque<string> _queue;
+    size_t _workerCount = 0;
+
+    HostResolver() = default;
+
+public:
+    // Instance
+    //
+    // The resolver is deliberately never destroyed: its worker threads may be stuck in
+    // getaddrinfo at exit, and there's no way to cancel that.
+
+    static HostResolver & Instance()
+    {
+        static HostResolver * instance = new HostResolver();
+        return *instance;
+    }
+
+    // Lookup
+    //
+    // Fills in address and returns Resolved if an address is known, or fills in error and
+    // returns Failed if the most recent lookup failed.  Otherwise returns Pending.
+
+    Status Lookup(const string & host, in_addr & address, string & error)
+    {
+        if (inet_pton(AF_INET, host.c_str(), &address) == 1)
+            return Status::Resolved;
+
+        lock_guard lock(_mutex);
+        auto now = steady_clock::now();
+        auto & entry = _cache[host];
+
+        if (now >= entry.expires && !entry.lookupQueued)
+            QueueLookup(host, entry);
+
+        if (entry.hasAddress)
+        {
+            address = entry.address;
+            return Status::Resolved;
+        }
+
+        if (!entry.error.empty() && now < entry.expires)
+        {
+            error = entry.error;
+            return Status::Failed;
+        }
+
+        return Status::Pending;
+    }
+
+    // Forget
+    //
+    // Drops a cached result, for instance because connecting to the address failed and the
+    // host may have moved
+
+    void Forget(const string & host)
+    {
+        lock_guard lock(_mutex);
+        auto it = _cache.find(host);
+        if (it != _cache.end() && !it->second.lookupQueued)
+            it->second.expires = steady_clock::time_point();
+    }
+
+private:
+    void QueueLookup(const string & host, Entry & entry)
+    {
+        entry.lookupQueued = true;
+        _queue.push_back(host);
+
+        if (_workerCount < kWorkerCount && _workerCount < _queue.size())
+        {
+            _workerCount++;
+            thread(&HostResolver::Worker, this).detach();
+        }
+        _workAvailable.notify_one();
+    }
+
+    void Worker()
+    {
+        unique_lock lock(_mutex);
+        while (true)
+        {
+            _workAvailable.wait(lock, [this] { return !_queue.empty(); });
+
+            string host = std::move(_queue.front());
+            _queue.pop_front();
+
+            lock.unlock();
+
+            addrinfo hints{};
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+
+            addrinfo * result = nullptr;
+            int status = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+
+            lock.lock();
+
+            auto & entry = _cache[host];
+            entry.lookupQueued = false;
+
+            if (status == 0 && result)
+            {
+                entry.hasAddress = true;
+                entry.address = reinterpret_cast<sockaddr_in *>(result->ai_addr)->sin_addr;
+                entry.error.clear();
+                entry.expires = steady_clock::now() + kPositiveTtl;
+            }
+            else
+            {
+                // Keep serving a previously resolved address; just try again sooner
+
+                entry.error = "could not resolve " + host + ": " + gai_strerror(status);
+                entry.expires = steady_clock::now() + kNegativeTtl;
+                logger->debug("Could not resolve {}: {}", host, gai_strerror(status));
+            }
+
+            if (result)
+                freeaddrinfo(result);
+        }
+    }
+};
@@ -9,9 +9,11 @@
 // with other languages, etc.
 
 #include "pixeltypes.h"
+#include "colortransform.h"
 #include <vector>
 #include <map>
 #include <chrono>
+#include <span>
 #include <string>
 #include "json.hpp"
 
@@ -29,6 +31,9 @@ public:
     virtual ~ILEDGraphics() = default;
 
     virtual const vector<CRGB> & GetPixels() const = 0;
+    virtual span<CRGB> Pixels() = 0;                    // Width() * Height() pixels, row by row
+    virtual span<CRGB> Row(uint32_t y) = 0;
+    virtual void WritePixels(uint32_t x, uint32_t y, span<const CRGB> pixels) = 0;  // Along row y, clipped at its end
     virtual uint32_t Width() const = 0;
     virtual uint32_t Height() const = 0;
     virtual void SetPixel(uint32_t x, uint32_t y, const CRGB& color) = 0;
@@ -37,6 +42,9 @@ public:
     virtual CRGB GetPixel(uint32_t x, uint32_t y) const = 0;
     virtual void Clear(const CRGB& color) = 0;
     virtual void FadeFrameBy(uint8_t dimAmount) = 0;
+    virtual void ScaleFrame(uint8_t scale) = 0;                         // Every channel times scale / 256
+    virtual void AddFrame(const ILEDGraphics& other) = 0;               // Saturating add of a frame the same size
+    virtual void BlendFrame(const ILEDGraphics& other, uint16_t weight) = 0;    // Toward other by weight / 256
     virtual void FillRectangle(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const CRGB& color) = 0;
     virtual void DrawLine(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2, const CRGB& color) = 0;
     virtual void DrawCircle(uint32_t x, uint32_t y, uint32_t radius, const CRGB& color) = 0;
@@ -89,6 +97,10 @@ public:
     // Determines if the schedule is currently active.
     // Optional fields (days, start/stop times, start/stop dates) are considered a match if not present.
     virtual bool IsActive() const = 0;
+    virtual bool IsActiveAt(system_clock::time_point when) const = 0;
+
+    // The earliest time after `after` at which IsActive might change, or time_point::max() if it never does
+    virtual system_clock::time_point NextTransition(system_clock::time_point after) const = 0;
 };
 
 struct ClientResponse;
@@ -117,8 +129,31 @@ public:
 
     virtual void SetSchedule(const shared_ptr<ISchedule> pSchedule) = 0;
     virtual const shared_ptr<ISchedule> GetSchedule() const = 0;
+
+    // True when what the effect draws depends only on the deltas passed to Update and not on
+    // the wall clock, so its frames can be rendered ahead of the time they're shown
+    virtual bool IsDeterministic() const = 0;
 };
 
+// TransitionType
+//
+// How the effects manager goes from one effect to the next
+
+enum class TransitionType : uint8_t
+{
+    Cut,            // Switch straight over
+    Crossfade,      // Fade from one to the other
+    Wipe,           // Sweep the new effect in from the left
+    Dissolve        // Switch pixels over one by one in a random order
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(TransitionType, {
+    { TransitionType::Cut,       "cut"       },
+    { TransitionType::Crossfade, "crossfade" },
+    { TransitionType::Wipe,      "wipe"      },
+    { TransitionType::Dissolve,  "dissolve"  }
+})
+
 // IEffectsManager
 //
 // Manages a collection of LED effects, allowing for cycling through effects, starting and stopping them,
@@ -148,10 +183,80 @@ public:
     virtual void Stop() = 0;
     virtual void SetFPS(uint16_t fps) = 0;
     virtual uint16_t GetFPS() const = 0;
+    virtual bool IsPipelined() const = 0;
+    virtual void SetPipelined(bool pipelined) = 0;
+    virtual milliseconds GetRenderAhead() const = 0;
+    virtual void SetRenderAhead(milliseconds lead) = 0;
+    virtual TransitionType GetTransitionType() const = 0;
+    virtual milliseconds GetTransitionDuration() const = 0;
+    virtual void SetTransition(TransitionType type, milliseconds duration) = 0;
     virtual void SetEffects(vector<shared_ptr<ILEDEffect>> effects) = 0;
     virtual void SetCurrentEffectIndex(int index) = 0;
 };
 
+// FramePtr
+//
+// A finished frame, ready to go on the wire.  Frames are immutable once built, so a frame that
+// several channels need to send can be shared between their queues.
+
+using FramePtr = shared_ptr<const vector<uint8_t>>;
+
+// BackpressurePolicy
+//
+// What a socket channel does when frames are produced faster than its client can take them.
+
+enum class BackpressurePolicy : uint8_t
+{
+    Reset,          // Drop the connection and everything queued once the queue is full
+    DropOldest,     // Discard the oldest queued frames to make room for new ones
+    DropNewest,     // Discard new frames that don't fit in the queue
+    LatestWins      // Skip queued frames that are already late whenever a newer one is waiting
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(BackpressurePolicy, {
+    { BackpressurePolicy::Reset,      "reset"      },
+    { BackpressurePolicy::DropOldest, "dropOldest" },
+    { BackpressurePolicy::DropNewest, "dropNewest" },
+    { BackpressurePolicy::LatestWins, "latestWins" }
+})
+
+// SocketTransport
+//
+// How a socket channel gets its frames to the client
+
+enum class SocketTransport : uint8_t
+{
+    Tcp,            // A single TCP connection per client
+    Udp             // Fragmented, sequenced datagrams; lost frames are skipped rather than resent
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(SocketTransport, {
+    { SocketTransport::Tcp, "tcp" },
+    { SocketTransport::Udp, "udp" }
+})
+
+// FrameCodec
+//
+// How a socket channel encodes frames before queueing them.  Every codec but Delta produces
+// frames that any client understands; Delta needs a client that knows how to apply it.
+
+enum class FrameCodec : uint8_t
+{
+    Zlib,           // zlib at the configured level, in a "DAVE" compressed frame
+    Raw,            // The data frame as is, for frames too small or noisy to compress
+    Rle,            // zlib limited to run length matches: much faster, still decodes as zlib
+    Delta,          // XOR against the previous frame, then zlib, with periodic keyframes
+    Auto            // Periodically measures Raw, Zlib and Rle and uses the best one
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(FrameCodec, {
+    { FrameCodec::Zlib,  "zlib"  },
+    { FrameCodec::Raw,   "raw"   },
+    { FrameCodec::Rle,   "rle"   },
+    { FrameCodec::Delta, "delta" },
+    { FrameCodec::Auto,  "auto"  }
+})
+
 // ISocketChannel
 //
 // Defines a communication protocol for managing socket connections and sending data to a server.
@@ -168,10 +273,12 @@ public:
     virtual uint16_t Port() const = 0;
 
     virtual uint32_t Id() const = 0;
+    virtual SocketTransport Transport() const = 0;
 
     // Data transfer methods
-    virtual bool EnqueueFrame(vector<uint8_t>&& frameData) = 0;
-    virtual vector<uint8_t> CompressFrame(const vector<uint8_t>& data) = 0;
+    virtual bool EnqueueFrame(vector<uint8_t>&& frameData, system_clock::time_point timestamp = system_clock::time_point()) = 0;
+    virtual bool EnqueueFrame(FramePtr frame, system_clock::time_point timestamp = system_clock::time_point()) = 0;
+    virtual FramePtr CompressFrame(const uint8_t * data, size_t size, size_t headerSize = 0, uint64_t pixelHash = 0) = 0;
 
     // Connection status
     virtual bool IsConnected() const = 0;
@@ -182,6 +289,44 @@ public:
     virtual string GetLastSocketError() const = 0;
     virtual size_t GetCurrentQueueDepth() const = 0;
     virtual size_t GetQueueMaxSize() const = 0;
+    virtual uint64_t GetSentFrameCount() const = 0;
+    virtual uint64_t GetLostFrameCount() const = 0;
+
+    // Batching of queued frames into a single send
+    virtual void SetBatchLimits(uint32_t maxFrames, uint32_t maxBytes) = 0;
+    virtual uint32_t GetBatchMaxFrames() const = 0;
+    virtual uint32_t GetBatchMaxBytes() const = 0;
+
+    // What to do when the client falls behind
+    virtual void SetBackpressurePolicy(BackpressurePolicy policy) = 0;
+    virtual BackpressurePolicy GetBackpressurePolicy() const = 0;
+    virtual uint64_t GetDroppedFrameCount() const = 0;
+
+    // Pacing of frames by how full the client's buffer is
+    virtual void SetFlowControl(bool enabled, double targetFill) = 0;
+    virtual bool IsFlowControlEnabled() const = 0;
+    virtual double GetFlowTargetFill() const = 0;
+    virtual double GetSendRatio() const = 0;
+    virtual uint64_t GetThrottledFrameCount() const = 0;
+
+    // How frames are encoded by CompressFrame
+    virtual void SetCodec(FrameCodec codec, int level) = 0;
+    virtual FrameCodec GetCodec() const = 0;
+    virtual int GetCompressionLevel() const = 0;
+    virtual FrameCodec GetActiveCodec() const = 0;
+    virtual double GetCompressionRatio() const = 0;
+
+    // Skipping frames whose pixels haven't changed, apart from periodic keepalives
+    virtual void SetSkipUnchanged(bool enabled, milliseconds keepalive) = 0;
+    virtual bool IsSkipUnchangedEnabled() const = 0;
+    virtual milliseconds GetKeepaliveInterval() const = 0;
+    virtual uint64_t GetSkippedFrameCount() const = 0;
+    virtual bool ShouldSendFrame(uint64_t pixelHash) = 0;
+
+    // Time spent building, compressing and queueing this channel's frames
+    virtual void RecordEncodeTime(nanoseconds elapsed) = 0;
+    virtual double GetLastEncodeMicros() const = 0;
+    virtual double GetAverageEncodeMicros() const = 0;
 
     // Start and stop operations
     virtual void Start() = 0;
@@ -212,6 +357,9 @@ public:
     virtual uint32_t ClientBufferCount() const = 0;
     virtual double   TimeOffset () const = 0;
 
+    // Gamma, color correction and brightness applied to the pixels this feature sends
+    virtual const ColorTransform & OutputTransform() const = 0;
+
     // Canvas association
     virtual void SetCanvas(const ICanvas * canvas) = 0;
 
@@ -219,6 +367,13 @@ public:
     virtual vector<uint8_t> GetPixelData() const = 0;
     virtual vector<uint8_t> GetDataFrame(system_clock::time_point targetTime) const = 0;
 
+    // In-place variants of the above, for building frames in pooled buffers.  The buffer passed
+    // to WritePixelData must hold Width() * Height() * 3 bytes, and the one passed to
+    // WriteDataFrame DataFrameSize() bytes.
+    virtual size_t DataFrameSize() const = 0;
+    virtual void WritePixelData(uint8_t * pixels) const = 0;
+    virtual void WriteDataFrame(system_clock::time_point targetTime, uint8_t * frame) const = 0;
+
     virtual shared_ptr<ISocketChannel> Socket() = 0;
     virtual const shared_ptr<ISocketChannel> Socket() const = 0;
 
@@ -247,6 +402,11 @@ public:
     virtual ILEDGraphics & Graphics() = 0;
     virtual const ILEDGraphics& Graphics() const = 0;
 
+    // Effects draw into Graphics(), while features send the last frame that was presented, so
+    // the next frame can be drawn while the previous one is still being encoded
+    virtual const ILEDGraphics& FrontGraphics() const = 0;
+    virtual void PresentFrame() = 0;
+
     virtual IEffectsManager & Effects() = 0;
     virtual const IEffectsManager & Effects() const = 0;
 };
@@ -266,6 +426,18 @@ public:
     virtual uint16_t GetPort() const = 0;
     virtual void     SetPort(uint16_t port) = 0;
 
+    // Number of shared socket reactor threads; 0 means each socket gets its own worker thread
+    virtual uint16_t GetIOThreads() const = 0;
+    virtual void     SetIOThreads(uint16_t threads) = 0;
+
+    // Number of shared threads that encode features in parallel; 0 encodes on each canvas's thread
+    virtual uint16_t GetEncodeThreads() const = 0;
+    virtual void     SetEncodeThreads(uint16_t threads) = 0;
+
+    // Number of shared threads that render every canvas; 0 gives each canvas its own thread
+    virtual uint16_t GetRenderThreads() const = 0;
+    virtual void     SetRenderThreads(uint16_t threads) = 0;
+
     virtual vector<shared_ptr<ICanvas>> Canvases() const = 0;
     virtual uint32_t AddCanvas(shared_ptr<ICanvas> ptrCanvas) = 0;
     virtual bool DeleteCanvasById(uint32_t id) = 0;
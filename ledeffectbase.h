@@ -42,5 +42,11 @@ public:
     {
         return _ptrSchedule;
     }
+
+    // Effects that only advance by the deltas they're given override this to allow rendering ahead
+    bool IsDeterministic() const override
+    {
+        return false;
+    }
 };
 
@@ -16,6 +16,7 @@ using namespace chrono;
 #include "interfaces.h"
 #include "utilities.h"
 #include "socketchannel.h"
+#include "udpchannel.h"
 
 class LEDFeature : public ILEDFeature
 {
@@ -28,6 +29,7 @@ class LEDFeature : public ILEDFeature
     uint8_t     _channel;
     bool        _redGreenSwap;
     uint32_t    _clientBufferCount;
+    ColorTransform _transform;
     shared_ptr<ISocketChannel> _ptrSocketChannel;
     static atomic<uint32_t> _nextId;
     uint32_t _id;
@@ -43,7 +45,9 @@ public:
                bool           reversed = false,
                uint8_t        channel = 0,
                bool           redGreenSwap = false,
-               uint32_t       clientBufferCount = 24)
+               uint32_t       clientBufferCount = 24,
+               SocketTransport transport = SocketTransport::Tcp,
+               const ColorTransform & transform = ColorTransform())
         : _width(width),
           _height(height),
           _offsetX(offsetX),
@@ -52,9 +56,13 @@ public:
           _channel(channel),
           _redGreenSwap(redGreenSwap),
           _clientBufferCount(clientBufferCount),
+          _transform(transform),
           _id(_nextId++)
     {
-        _ptrSocketChannel = make_shared<SocketChannel>(hostName, friendlyName, port);
+        if (transport == SocketTransport::Udp)
+            _ptrSocketChannel = make_shared<UdpSocketChannel>(hostName, friendlyName, port);
+        else
+            _ptrSocketChannel = make_shared<SocketChannel>(hostName, friendlyName, port);
     }
 
     uint32_t Id() const override
@@ -77,6 +85,7 @@ public:
     uint8_t         Channel()           const override { return _channel; }
     bool            RedGreenSwap()      const override { return _redGreenSwap; }
     uint32_t        ClientBufferCount() const override { return _clientBufferCount; }
+    const ColorTransform & OutputTransform() const override { return _transform; }
 
     void SetCanvas(const ICanvas * canvas) override
     {
@@ -103,22 +112,33 @@ public:
         return _ptrSocketChannel;
     }
 
+    // Size of the Type 3 NightDriver Protocol header that precedes the pixels in a data frame
+
+    static constexpr size_t kDataFrameHeaderSize = 24;
+
     vector<uint8_t> GetPixelData() const override
+    {
+        vector<uint8_t> result(static_cast<size_t>(_width) * _height * sizeof(CRGB));
+        WritePixelData(result.data());
+        return result;
+    }
+
+    void WritePixelData(uint8_t * pixels) const override
     {
         static_assert(sizeof(CRGB) == 3, "CRGB must be 3 bytes in size for this code to work.");
 
         if (!_canvas)
             throw runtime_error("LEDFeature must be associated with a canvas to retrieve pixel data.");
 
-        const auto& graphics = _canvas->Graphics();
+        const auto& graphics = _canvas->FrontGraphics();
 
         // Fast path for full canvas.  We assume this is the default case and optimize for it by telling the compiler to expect it.
         if (__builtin_expect(_width == graphics.Width() && _height == graphics.Height() && _offsetX == 0 && _offsetY == 0 && (!_reversed || _height == 1), 1))
-
-            return Utilities::ConvertPixelsToByteArray(graphics.GetPixels(), _reversed, _redGreenSwap);
-
-        // Pre-calculate the final buffer size (3 bytes per pixel)
-        vector<uint8_t> result(static_cast<size_t>(_width) * _height * sizeof(CRGB));
+        {
+            const auto & canvasPixels = graphics.GetPixels();
+            Utilities::WritePixels(canvasPixels.data(), canvasPixels.size(), _reversed, _redGreenSwap, pixels, &_transform);
+            return;
+        }
 
         // Direct byte manipulation instead of intermediate CRGB vector
         for (uint32_t y = 0; y < _height; ++y)
@@ -135,45 +155,60 @@ public:
 
                 if (canvasX < graphics.Width() && canvasY < graphics.Height())
                 {
-                    const CRGB& pixel = graphics.GetPixel(canvasX, canvasY);
+                    const CRGB pixel = _transform.Apply(graphics.GetPixel(canvasX, canvasY));
                     if (_redGreenSwap)
                     {
-                        result[byteIndex] = pixel.g;
-                        result[byteIndex + 1] = pixel.r;
-                        result[byteIndex + 2] = pixel.b;
+                        pixels[byteIndex] = pixel.g;
+                        pixels[byteIndex + 1] = pixel.r;
+                        pixels[byteIndex + 2] = pixel.b;
                     }
                     else
                     {
-                        result[byteIndex] = pixel.r;
-                        result[byteIndex + 1] = pixel.g;
-                        result[byteIndex + 2] = pixel.b;
+                        pixels[byteIndex] = pixel.r;
+                        pixels[byteIndex + 1] = pixel.g;
+                        pixels[byteIndex + 2] = pixel.b;
                     }
                 }
                 else
                 {
-                    result[byteIndex] = 0xFF;
-                    result[byteIndex + 1] = 0x00;
-                    result[byteIndex + 2] = 0xFF;
+                    pixels[byteIndex] = 0xFF;
+                    pixels[byteIndex + 1] = 0x00;
+                    pixels[byteIndex + 2] = 0xFF;
                 }
             }
         }
 
         if (_reversed && _height == 1)
         {
-            const size_t numPixels = result.size() / 3;
+            const size_t numPixels = _width;
             for (size_t i = 0; i < numPixels / 2; ++i) {
                 size_t front = i * 3;
                 size_t back = (numPixels - 1 - i) * 3;
-                swap(result[front], result[back]);
-                swap(result[front + 1], result[back + 1]);
-                swap(result[front + 2], result[back + 2]);
+                swap(pixels[front], pixels[back]);
+                swap(pixels[front + 1], pixels[back + 1]);
+                swap(pixels[front + 2], pixels[back + 2]);
             }
         }
-
-        return result;
     }
 
     vector<uint8_t> GetDataFrame(system_clock::time_point targetTime) const override
+    {
+        vector<uint8_t> frame(DataFrameSize());
+        WriteDataFrame(targetTime, frame.data());
+        return frame;
+    }
+
+    size_t DataFrameSize() const override
+    {
+        return kDataFrameHeaderSize + static_cast<size_t>(_width) * _height * sizeof(CRGB);
+    }
+
+    // WriteDataFrame
+    //
+    // Writes the header into the first kDataFrameHeaderSize bytes of the buffer and the pixels
+    // right after it, so the frame never needs to be stitched together from pieces
+
+    void WriteDataFrame(system_clock::time_point targetTime, uint8_t * frame) const override
     {
         // Standard Type 3 NightDriver Protocol Header
         auto futureTime = targetTime + microseconds(static_cast<long long>(TimeOffset() * 1000000.0));
@@ -182,15 +217,13 @@ public:
         uint64_t seconds = epoch / 1'000'000;
         uint64_t microseconds = epoch % 1'000'000;
 
-        auto pixelData = GetPixelData();
+        auto out = Utilities::WriteBytes(frame, Utilities::WORDToBytes(3));
+        out = Utilities::WriteBytes(out, Utilities::WORDToBytes(_channel));
+        out = Utilities::WriteBytes(out, Utilities::DWORDToBytes(_width * _height));
+        out = Utilities::WriteBytes(out, Utilities::ULONGToBytes(seconds));
+        out = Utilities::WriteBytes(out, Utilities::ULONGToBytes(microseconds));
 
-        return Utilities::CombineByteArrays(
-            Utilities::WORDToBytes(3),
-            Utilities::WORDToBytes(_channel),
-            Utilities::DWORDToBytes(_width * _height),
-            Utilities::ULONGToBytes(seconds),
-            Utilities::ULONGToBytes(microseconds),
-            std::move(pixelData));
+        WritePixelData(out);
     }
 };
 
@@ -199,6 +232,7 @@ inline void to_json(nlohmann::json& j, const ILEDFeature & feature)
     j = {
             {"id",                feature.Id()},
             {"hostName",          feature.Socket()->HostName()},
+            {"transport",         feature.Socket()->Transport()},
             {"friendlyName",      feature.Socket()->FriendlyName()},
             {"port",              feature.Socket()->Port()},
             {"width",             feature.Width()},
@@ -210,10 +244,33 @@ inline void to_json(nlohmann::json& j, const ILEDFeature & feature)
             {"redGreenSwap",      feature.RedGreenSwap()},
             {"clientBufferCount", feature.ClientBufferCount()},
             {"timeOffset",        feature.TimeOffset()},
+            {"gamma",             feature.OutputTransform().Gamma()},
+            {"colorCorrection",   feature.OutputTransform().Correction()},
+            {"colorTemperature",  feature.OutputTransform().Temperature()},
+            {"brightness",        feature.OutputTransform().Brightness()},
             {"bytesPerSecond",    feature.Socket()->GetLastBytesPerSecond()},
             {"isConnected",       feature.Socket()->IsConnected()},
             {"queueDepth",        feature.Socket()->GetCurrentQueueDepth()},
             {"queueMaxSize",      feature.Socket()->GetQueueMaxSize()},
+            {"batchFrames",       feature.Socket()->GetBatchMaxFrames()},
+            {"batchBytes",        feature.Socket()->GetBatchMaxBytes()},
+            {"backpressure",      feature.Socket()->GetBackpressurePolicy()},
+            {"droppedFrames",     feature.Socket()->GetDroppedFrameCount()},
+            {"flowControl",       feature.Socket()->IsFlowControlEnabled()},
+            {"flowTargetFill",    feature.Socket()->GetFlowTargetFill()},
+            {"sendRatio",         feature.Socket()->GetSendRatio()},
+            {"throttledFrames",   feature.Socket()->GetThrottledFrameCount()},
+            {"sentFrames",        feature.Socket()->GetSentFrameCount()},
+            {"lostFrames",        feature.Socket()->GetLostFrameCount()},
+            {"codec",             feature.Socket()->GetCodec()},
+            {"compressionLevel",  feature.Socket()->GetCompressionLevel()},
+            {"activeCodec",       feature.Socket()->GetActiveCodec()},
+            {"compressionRatio",  feature.Socket()->GetCompressionRatio()},
+            {"skipUnchanged",     feature.Socket()->IsSkipUnchangedEnabled()},
+            {"keepaliveMs",       feature.Socket()->GetKeepaliveInterval().count()},
+            {"skippedFrames",     feature.Socket()->GetSkippedFrameCount()},
+            {"encodeMicros",      feature.Socket()->GetLastEncodeMicros()},
+            {"averageEncodeMicros", feature.Socket()->GetAverageEncodeMicros()},
             {"reconnectCount",    feature.Socket()->GetReconnectCount()},
             {"failedConnectCount", feature.Socket()->GetFailedConnectCount()},
             {"lastSocketError",   feature.Socket()->GetLastSocketError()}
@@ -237,9 +294,30 @@ inline void from_json(const nlohmann::json& j, shared_ptr<ILEDFeature> & feature
         j.value("reversed", false),
         j.value("channel", uint8_t(0)),
         j.value("redGreenSwap", false),
-        j.value("clientBufferCount", uint32_t(500))
+        j.value("clientBufferCount", uint32_t(500)),
+        j.value("transport", SocketTransport::Tcp),
+        j.get<ColorTransform>()
     );
 
+    if (j.contains("batchFrames") || j.contains("batchBytes"))
+        feature->Socket()->SetBatchLimits(j.value("batchFrames", uint32_t(1)),
+                                          j.value("batchBytes", uint32_t(64 * 1024)));
+
+    if (j.contains("backpressure"))
+        feature->Socket()->SetBackpressurePolicy(j.at("backpressure").get<BackpressurePolicy>());
+
+    if (j.contains("flowControl"))
+        feature->Socket()->SetFlowControl(j.at("flowControl").get<bool>(),
+                                          j.value("flowTargetFill", FlowController::kDefaultTargetFill));
+
+    if (j.contains("codec") || j.contains("compressionLevel"))
+        feature->Socket()->SetCodec(j.value("codec", FrameCodec::Zlib),
+                                    j.value("compressionLevel", int(Z_BEST_SPEED)));
+
+    if (j.contains("skipUnchanged"))
+        feature->Socket()->SetSkipUnchanged(j.at("skipUnchanged").get<bool>(),
+                                            milliseconds(j.value("keepaliveMs", int64_t(FrameEncoder::kDefaultKeepalive.count()))));
+
     if (j.contains("id"))
         feature->SetId(j.at("id").get<uint32_t>());
 }
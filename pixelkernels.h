@@ -0,0 +1,279 @@
+#pragma once
+using namespace std;
+
+// PixelKernels
+//
+// The bulk pixel operations that every frame goes through: fading, filling, adding and mixing
+// whole buffers, and swapping red and green for GRB strips.  They work on the packed 24-bit
+// pixel buffer as bytes, since every channel gets the same treatment.
+//
+// Each operation comes in a portable version and, on x86-64, in SSE2 and AVX2 versions.  The
+// best set the CPU supports is picked once, the first time it's needed, so one binary runs
+// everywhere.  Elsewhere the portable versions are all there is, and they are written so the
+// compiler can vectorize them for the target (NEON on Apple silicon, for example).
+//
+// Every version produces exactly the same bytes as the portable one.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "pixeltypes.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+enum class KernelLevel : uint8_t
+{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+struct PixelKernels
+{
+    KernelLevel level;
+    const char * name;
+
+    // bytes[i] = bytes[i] * scale / 256
+    void (*scale)(uint8_t * bytes, size_t count, uint8_t scale);
+
+    // Every pixel set to color
+    void (*fill)(CRGB * pixels, size_t count, CRGB color);
+
+    // dst[i] = min(255, dst[i] + src[i])
+    void (*addSaturate)(uint8_t * __restrict dst, const uint8_t * __restrict src, size_t count);
+
+    // dst[i] moved toward src[i] by weight / 256, for weights from 0 to 256
+    void (*blend)(uint8_t * __restrict dst, const uint8_t * __restrict src, size_t count, uint16_t weight);
+
+    // RGB to GRB or back: the first two bytes of every pixel swapped.  dst and src can't overlap.
+    void (*swapRedGreen)(uint8_t * __restrict dst, const uint8_t * __restrict src, size_t pixels);
+
+    // Active
+    //
+    // The fastest kernels this CPU can run
+
+    static const PixelKernels & Active()
+    {
+        static const PixelKernels & kernels = For(BestLevel());
+        return kernels;
+    }
+
+    static KernelLevel BestLevel()
+    {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? KernelLevel::AVX2 : KernelLevel::SSE2;
+#else
+        return KernelLevel::Scalar;
+#endif
+    }
+
+    // For
+    //
+    // The kernels for a given level, for benchmarks and tests that compare them.  Asking for a
+    // level the CPU doesn't support gets the best one it does.
+
+    static const PixelKernels & For(KernelLevel level)
+    {
+        static const PixelKernels scalar = { KernelLevel::Scalar, "scalar", ScaleScalar, FillScalar, AddSaturateScalar, BlendScalar, SwapRedGreenScalar };
+#if defined(__x86_64__)
+        static const PixelKernels sse2   = { KernelLevel::SSE2,   "sse2",   ScaleSSE2,   FillSSE2,   AddSaturateSSE2,   BlendSSE2,   SwapRedGreenSSE2 };
+        static const PixelKernels avx2   = { KernelLevel::AVX2,   "avx2",   ScaleAVX2,   FillSSE2,   AddSaturateAVX2,   BlendAVX2,   SwapRedGreenSSE2 };
+
+        level = min(level, BestLevel());
+        if (level == KernelLevel::AVX2)
+            return avx2;
+        if (level == KernelLevel::SSE2)
+            return sse2;
+#endif
+        return scalar;
+    }
+
+private:
+    // Portable versions, which also finish off whatever is left over after the vector loops
+
+    static void ScaleScalar(uint8_t * bytes, size_t count, uint8_t scale)
+    {
+        for (size_t i = 0; i < count; i++)
+            bytes[i] = static_cast<uint8_t>((bytes[i] * scale) >> 8);
+    }
+
+    static void FillScalar(CRGB * pixels, size_t count, CRGB color)
+    {
+        std::fill(pixels, pixels + count, color);
+    }
+
+    static void AddSaturateScalar(uint8_t * __restrict dst, const uint8_t * __restrict src, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+            dst[i] = static_cast<uint8_t>(min(255, dst[i] + src[i]));
+    }
+
+    // The same as dst + (src - dst) * weight / 256, but without going negative, which lets the
+    // vector versions stay in unsigned 16-bit lanes
+
+    static void BlendScalar(uint8_t * __restrict dst, const uint8_t * __restrict src, size_t count, uint16_t weight)
+    {
+        const uint16_t keep = 256 - weight;
+        for (size_t i = 0; i < count; i++)
+            dst[i] = static_cast<uint8_t>((dst[i] * keep + src[i] * weight) >> 8);
+    }
+
+    static void SwapRedGreenScalar(uint8_t * __restrict dst, const uint8_t * __restrict src, size_t pixels)
+    {
+        for (size_t i = 0; i < pixels * 3; i += 3)
+        {
+            dst[i]     = src[i + 1];
+            dst[i + 1] = src[i];
+            dst[i + 2] = src[i + 2];
+        }
+    }
+
+#if defined(__x86_64__)
+    // SSE2 is part of x86-64, so these need no check
+
+    static void ScaleSSE2(uint8_t * bytes, size_t count, uint8_t scale)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i factor = _mm_set1_epi16(scale);
+
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+            __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), factor), 8);
+            __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), factor), 8);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + i), _mm_packus_epi16(lo, hi));
+        }
+        ScaleScalar(bytes + i, count - i, scale);
+    }
+
+    // Three vectors hold 16 whole pixels, which are then stored over and over.  The same thing
+    // with 32-byte vectors measured slower, so the AVX2 set uses this one too.
+
+    static void FillSSE2(CRGB * pixels, size_t count, CRGB color)
+    {
+        alignas(16) CRGB pattern[16];
+        std::fill(begin(pattern), end(pattern), color);
+        const __m128i p0 = _mm_load_si128(reinterpret_cast<const __m128i *>(pattern));
+        const __m128i p1 = _mm_load_si128(reinterpret_cast<const __m128i *>(pattern) + 1);
+        const __m128i p2 = _mm_load_si128(reinterpret_cast<const __m128i *>(pattern) + 2);
+
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            auto out = reinterpret_cast<__m128i *>(pixels + i);
+            _mm_storeu_si128(out, p0);
+            _mm_storeu_si128(out + 1, p1);
+            _mm_storeu_si128(out + 2, p2);
+        }
+        FillScalar(pixels + i, count - i, color);
+    }
+
+    static void AddSaturateSSE2(uint8_t * __restrict dst, const uint8_t * __restrict src, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_adds_epu8(d, s));
+        }
+        AddSaturateScalar(dst + i, src + i, count - i);
+    }
+
+    static void BlendSSE2(uint8_t * __restrict dst, const uint8_t * __restrict src, size_t count, uint16_t weight)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i keep = _mm_set1_epi16(static_cast<short>(256 - weight));
+        const __m128i take = _mm_set1_epi16(static_cast<short>(weight));
+
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), keep), _mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), take));
+            __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), keep), _mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), take));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+        }
+        BlendScalar(dst + i, src + i, count - i, weight);
+    }
+
+    // Five pixels per 16-byte vector: each byte takes its neighbour from one side or the other,
+    // or stays put for blue.  The 16th byte comes out wrong and is rewritten by the next pass,
+    // which is why dst and src can't overlap.  AVX2 doesn't help here, since its byte shifts
+    // stay within 16-byte lanes that don't line up with 3-byte pixels.
+
+    static void SwapRedGreenSSE2(uint8_t * __restrict dst, const uint8_t * __restrict src, size_t pixels)
+    {
+        const __m128i fromNext = _mm_setr_epi8(-1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, 0);
+        const __m128i fromPrev = _mm_slli_si128(fromNext, 1);
+        const __m128i stay     = _mm_slli_si128(fromNext, 2);
+
+        size_t bytes = pixels * 3;
+        size_t i = 0;
+        for (; i + 16 <= bytes; i += 15)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            __m128i swapped = _mm_or_si128(_mm_and_si128(v, stay),
+                              _mm_or_si128(_mm_and_si128(_mm_srli_si128(v, 1), fromNext),
+                                           _mm_and_si128(_mm_slli_si128(v, 1), fromPrev)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), swapped);
+        }
+        SwapRedGreenScalar(dst + i, src + i, (bytes - i) / 3);
+    }
+
+    __attribute__((target("avx2")))
+    static void ScaleAVX2(uint8_t * bytes, size_t count, uint8_t scale)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i factor = _mm256_set1_epi16(scale);
+
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + i));
+            __m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), factor), 8);
+            __m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), factor), 8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(bytes + i), _mm256_packus_epi16(lo, hi));
+        }
+        ScaleSSE2(bytes + i, count - i, scale);
+    }
+
+    __attribute__((target("avx2")))
+    static void AddSaturateAVX2(uint8_t * __restrict dst, const uint8_t * __restrict src, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+            __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_adds_epu8(d, s));
+        }
+        AddSaturateSSE2(dst + i, src + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    static void BlendAVX2(uint8_t * __restrict dst, const uint8_t * __restrict src, size_t count, uint16_t weight)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i keep = _mm256_set1_epi16(static_cast<short>(256 - weight));
+        const __m256i take = _mm256_set1_epi16(static_cast<short>(weight));
+
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+            __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), keep), _mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero), take));
+            __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), keep), _mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero), take));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+        }
+        BlendSSE2(dst + i, src + i, count - i, weight);
+    }
+#endif
+};
@@ -0,0 +1,192 @@
+#pragma once
+using namespace std;
+
+// PlanarSurface
+//
+// A drawing surface with 16 bits per channel, for effects that build a frame up over many
+// frames by fading and adding.  In 8 bits every fade rounds each channel down, so dim trails
+// band and stall, and anti-aliased edges only have 256 levels to land on.  Here a channel is
+// fixed point with 8 bits below the 8-bit value, so those steps keep their fractions.
+//
+// The channels are kept in separate planes, which makes every operation a plain loop over one
+// array of uint16_t that the compiler vectorizes with no shuffling.
+//
+// An effect keeps one of these as its own state, draws into it, and at the end of the frame
+// calls Quantize to write it to the canvas once.  Quantizing adds a fixed ordered dither, so
+// levels between two 8-bit values come out as a mix of both rather than all rounding one way,
+// and the same surface always quantizes to the same bytes.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "interfaces.h"
+#include "pixeltypes.h"
+
+class PlanarSurface
+{
+public:
+    static constexpr uint32_t kOne = 256;                   // One 8-bit step
+
+private:
+    uint32_t _width = 0;
+    uint32_t _height = 0;
+    array<vector<uint16_t>, 3> _planes;                     // Red, green and blue
+
+    // Thresholds for the dither: the bit-reversed pixel index, so that any run of pixels
+    // samples the whole range evenly, which works for single strips as well as matrices
+
+    static const array<uint16_t, 256> & DitherThresholds()
+    {
+        static const array<uint16_t, 256> thresholds = []
+        {
+            array<uint16_t, 256> table{};
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t reversed = 0;
+                for (int bit = 0; bit < 8; bit++)
+                    reversed |= ((i >> bit) & 1) << (7 - bit);
+                table[i] = static_cast<uint16_t>(reversed);
+            }
+            return table;
+        }();
+        return thresholds;
+    }
+
+public:
+    PlanarSurface() = default;
+
+    PlanarSurface(uint32_t width, uint32_t height)
+    {
+        Resize(width, height);
+    }
+
+    uint32_t Width() const  { return _width; }
+    uint32_t Height() const { return _height; }
+
+    // Resize
+    //
+    // Does nothing when the size is unchanged; otherwise the surface starts over black
+
+    void Resize(uint32_t width, uint32_t height)
+    {
+        if (width == _width && height == _height)
+            return;
+
+        _width = width;
+        _height = height;
+        for (auto &plane : _planes)
+            plane.assign(static_cast<size_t>(width) * height, 0);
+    }
+
+    void Clear()
+    {
+        for (auto &plane : _planes)
+            fill(plane.begin(), plane.end(), 0);
+    }
+
+    // The value of a pixel in 8-bit steps, fraction and all
+
+    array<float, 3> GetPixel(uint32_t x, uint32_t y) const
+    {
+        if (x >= _width || y >= _height)
+            return { 0, 0, 0 };
+
+        size_t index = static_cast<size_t>(y) * _width + x;
+        return { _planes[0][index] / float(kOne), _planes[1][index] / float(kOne), _planes[2][index] / float(kOne) };
+    }
+
+    // FadeFrameBy
+    //
+    // The same fade as ILEDGraphics::FadeFrameBy, scaling by (255 - dimAmount) / 256, but keeping
+    // the fraction
+
+    void FadeFrameBy(uint8_t dimAmount)
+    {
+        const uint32_t scale = 255 - dimAmount;
+        for (auto &plane : _planes)
+            for (auto &value : plane)
+                value = static_cast<uint16_t>((value * scale) >> 8);
+    }
+
+    // BlendFrame
+    //
+    // Moves every pixel toward other's by weight / 256, for weights from 0 to 256
+
+    void BlendFrame(const PlanarSurface &other, uint16_t weight)
+    {
+        if (other._width != _width || other._height != _height)
+            throw invalid_argument("Surfaces to blend must be the same size");
+
+        const uint32_t take = min<uint32_t>(weight, 256);
+        const uint32_t keep = 256 - take;
+        for (size_t c = 0; c < _planes.size(); c++)
+        {
+            auto dst = _planes[c].data();
+            auto src = other._planes[c].data();
+            for (size_t i = 0; i < _planes[c].size(); i++)
+                dst[i] = static_cast<uint16_t>((dst[i] * keep + src[i] * take) >> 8);
+        }
+    }
+
+    // SetPixelsF
+    //
+    // Draws color over count pixels from fPos in the surface's row-by-row order, like the
+    // ILEDGraphics version.  Partly covered pixels at either end get the color in proportion
+    // to how much of them is covered.  Merging adds the color, saturating at the top of the
+    // 16-bit range, where the ILEDGraphics version would have saturated at 255.
+
+    void SetPixelsF(float fPos, float count, CRGB color, bool bMerge = false)
+    {
+        const size_t size = _planes[0].size();
+        const float end = fPos + count;
+        if (count <= 0 || end <= 0 || fPos >= size)
+            return;
+
+        const size_t first = static_cast<size_t>(max(0.0f, floor(fPos)));
+        const size_t last = min(size, static_cast<size_t>(ceil(end)));
+
+        for (size_t i = first; i < last; i++)
+        {
+            float coverage = min(static_cast<float>(i + 1), end) - max(static_cast<float>(i), fPos);
+            uint32_t take = static_cast<uint32_t>(lround(clamp(coverage, 0.0f, 1.0f) * 256));
+
+            for (size_t c = 0; c < _planes.size(); c++)
+            {
+                uint32_t value = _planes[c][i];
+                uint32_t paint = color.raw[c] * take;
+                value = bMerge ? min<uint32_t>(UINT16_MAX, value + paint)
+                               : (value * (256 - take) + paint * kOne) >> 8;
+                _planes[c][i] = static_cast<uint16_t>(value);
+            }
+        }
+    }
+
+    // Quantize
+    //
+    // Writes the surface to graphics of the same size, dithered down to 8 bits per channel
+
+    void Quantize(ILEDGraphics &graphics) const
+    {
+        if (graphics.Width() != _width || graphics.Height() != _height)
+            throw invalid_argument("Can only quantize to graphics of the same size");
+
+        const auto &thresholds = DitherThresholds();
+        auto out = graphics.Pixels();
+        const size_t count = out.size();
+
+        for (size_t start = 0; start < count; start += thresholds.size())
+        {
+            size_t run = min(thresholds.size(), count - start);
+            auto dst = out.data() + start;
+            for (size_t c = 0; c < _planes.size(); c++)
+            {
+                auto src = _planes[c].data() + start;
+                for (size_t i = 0; i < run; i++)
+                    dst[i].raw[c] = static_cast<uint8_t>(min<uint32_t>(255, (src[i] + thresholds[i]) >> 8));
+            }
+        }
+    }
+};
@@ -1,13 +1,14 @@
 #pragma once
 using namespace std;
+using namespace chrono;
 
 #include <optional>
 #include <string>
 #include <cstdint>
 #include <chrono>
+#include <cstdio>
 #include <ctime>
-#include <sstream>
-#include <iomanip>
+#include <stdexcept>
 
 #include "global.h"
 #include "interfaces.h"
@@ -21,10 +22,10 @@ public:
 
     // Setters
     void SetDaysOfWeek(uint8_t days) override { daysOfWeek = days; } 
-    void SetStartTime(const string& time) override { startTime = time; }
-    void SetStopTime(const string& time) override { stopTime = time; }
-    void SetStartDate(const string& date) override { startDate = date; }
-    void SetStopDate(const string& date) override { stopDate = date; }
+    void SetStartTime(const string& time) override { startSecond = ParseTime(time); startTime = time; }
+    void SetStopTime(const string& time) override { stopSecond = ParseTime(time); stopTime = time; }
+    void SetStartDate(const string& date) override { startDay = ParseDate(date); startDate = date; }
+    void SetStopDate(const string& date) override { stopDay = ParseDate(date); stopDate = date; }
 
     // Getters
     optional<uint8_t> GetDaysOfWeek()  const override { return daysOfWeek; }
@@ -61,56 +62,51 @@ public:
 
     bool IsActive() const override
     {
-        // Get current time in system local time
-        auto now = system_clock::now();
-        time_t now_c = chrono::system_clock::to_time_t(now);
-        tm *localTime = localtime(&now_c);
+        return IsActiveAt(system_clock::now());
+    }
+
+    bool IsActiveAt(system_clock::time_point when) const override
+    {
+        auto local = ToLocalTime(when);
 
         // Check day-of-week: if daysOfWeek is set, today's bit must be on.
-        // Note: localTime->tm_wday: Sunday == 0, Monday == 1, etc.
+        // Note: weekday: Sunday == 0, Monday == 1, etc.
         if (daysOfWeek) {
-            uint8_t todayBit = 1 << localTime->tm_wday;
+            uint8_t todayBit = 1 << local.weekday;
             if (!(*daysOfWeek & todayBit)) {
                 logger->debug("Schedule inactive: day bit {} not in mask {}", todayBit, *daysOfWeek);
                 return false;
             }
         }
 
-        // Format current date and time as strings in "YYYY-MM-DD" and "HH:MM:SS" formats.
-        ostringstream dateStream, timeStream;
-        dateStream << put_time(localTime, "%Y-%m-%d");
-        timeStream << put_time(localTime, "%H:%M:%S");
-        string currentDate = dateStream.str();
-        string currentTime = timeStream.str();
-
         // Check start and stop dates if set.
-        if (startDate && currentDate < *startDate) {
+        if (startDay && local.day < *startDay) {
             return false;
         }
 
-        if (stopDate && currentDate > *stopDate) {
+        if (stopDay && local.day > *stopDay) {
             return false;
         }
 
         // Check start and stop times if set.
-        if (startTime && stopTime) {
-            if (*startTime <= *stopTime) {
+        if (startSecond && stopSecond) {
+            if (*startSecond <= *stopSecond) {
                 // Normal range (e.g., 08:00:00 to 17:00:00)
-                if (currentTime < *startTime || currentTime > *stopTime) {
+                if (local.second < *startSecond || local.second > *stopSecond) {
                     return false;
                 }
             } else {
                 // Overnight range (e.g., 22:00:00 to 06:00:00)
-                if (currentTime < *startTime && currentTime > *stopTime) {
+                if (local.second < *startSecond && local.second > *stopSecond) {
                     return false;
                 }
             }
-        } else if (startTime) {
-            if (currentTime < *startTime) {
+        } else if (startSecond) {
+            if (local.second < *startSecond) {
                 return false;
             }
-        } else if (stopTime) {
-            if (currentTime > *stopTime) {
+        } else if (stopSecond) {
+            if (local.second > *stopSecond) {
                 return false;
             }
         }
@@ -118,12 +114,92 @@ public:
         return true;
     }
 
+    // NextTransition
+    //
+    // Whether the schedule matches can only change at midnight, when the day and date change,
+    // at the start time, or just after the stop time, since the stop time itself still matches
+
+    system_clock::time_point NextTransition(system_clock::time_point after) const override
+    {
+        if (!daysOfWeek && !startDay && !stopDay && !startSecond && !stopSecond)
+            return system_clock::time_point::max();
+
+        auto local = ToLocalTime(after);
+        int32_t next = kSecondsPerDay - local.second;
+
+        for (auto boundary : { startSecond, stopSecond ? optional<int32_t>(*stopSecond + 1) : nullopt })
+            if (boundary && *boundary > local.second)
+                next = min(next, *boundary - local.second);
+
+        return floor<seconds>(after) + seconds(next);
+    }
+
 private:
     optional<uint8_t> daysOfWeek;  // Bitmask for days of week
     optional<string>  startTime;   // Format: "HH:MM:SS"
     optional<string>  stopTime;    // Format: "HH:MM:SS"
     optional<string>  startDate;   // Format: "YYYY-MM-DD"
     optional<string>  stopDate;    // Format: "YYYY-MM-DD"
+
+    // The same bounds compiled when they're set, so checking the schedule is integer comparisons
+
+    optional<int32_t> startSecond; // Seconds since midnight
+    optional<int32_t> stopSecond;
+    optional<int32_t> startDay;    // Days since 1970-01-01
+    optional<int32_t> stopDay;
+
+    static constexpr int32_t kSecondsPerDay = 24 * 60 * 60;
+
+    struct LocalTime
+    {
+        int     weekday;               // Sunday == 0
+        int32_t day;                   // Days since 1970-01-01
+        int32_t second;                // Seconds since midnight
+    };
+
+    static LocalTime ToLocalTime(system_clock::time_point when)
+    {
+        time_t time = system_clock::to_time_t(when);
+        tm local;
+        localtime_r(&time, &local);
+
+        auto day = sys_days(year(local.tm_year + 1900) / month(local.tm_mon + 1) / chrono::day(local.tm_mday));
+        return { local.tm_wday, static_cast<int32_t>(day.time_since_epoch().count()), local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec };
+    }
+
+    // ParseTime
+    //
+    // "HH:MM:SS", or "HH:MM" for the start of that minute
+
+    static int32_t ParseTime(const string& time)
+    {
+        unsigned hours = 0, minutes = 0, secs = 0;
+        int length = 0;
+        int fields = sscanf(time.c_str(), "%2u:%2u%n:%2u%n", &hours, &minutes, &length, &secs, &length);
+
+        if (fields < 2 || length != static_cast<int>(time.size()) || hours > 23 || minutes > 59 || secs > 59)
+            throw invalid_argument("Invalid schedule time '" + time + "', expected HH:MM:SS");
+
+        return hours * 3600 + minutes * 60 + secs;
+    }
+
+    // ParseDate
+    //
+    // "YYYY-MM-DD"
+
+    static int32_t ParseDate(const string& date)
+    {
+        int y = 0;
+        unsigned m = 0, d = 0;
+        int length = 0;
+        sscanf(date.c_str(), "%4d-%2u-%2u%n", &y, &m, &d, &length);
+
+        year_month_day ymd = year(y) / month(m) / chrono::day(d);
+        if (length != static_cast<int>(date.size()) || !ymd.ok())
+            throw invalid_argument("Invalid schedule date '" + date + "', expected YYYY-MM-DD");
+
+        return static_cast<int32_t>(sys_days(ymd).time_since_epoch().count());
+    }
 };
 
 
@@ -8,13 +8,15 @@ using namespace std;
 #include <atomic>
 #include <chrono>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <stdexcept>
+#include <random>
 #include <cstdint>
 #include <cstring>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <poll.h>
@@ -25,6 +27,12 @@ using namespace std;
 #include "interfaces.h"
 #include "utilities.h"
 #include "pixeltypes.h"
+#include "socketreactor.h"
+#include "framepool.h"
+#include "framecodec.h"
+#include "framering.h"
+#include "flowcontroller.h"
+#include "hostresolver.h"
 
 // How long to wait for a connection to be established or data sent
 
@@ -99,6 +107,60 @@ public:
     }
 };
 
+// ReconnectBackoff
+//
+// Decides when a channel that isn't connected may try again.  Attempts are always at least
+// kBaseDelay apart, and every failure in a row doubles the wait up to kMaxDelay.  The actual
+// wait is randomized between half and all of that, so that a controller with hundreds of
+// offline clients doesn't retry all of them in lockstep.
+
+class ReconnectBackoff
+{
+public:
+    static constexpr auto kBaseDelay = 1000ms;
+    static constexpr auto kMaxDelay  = 60000ms;
+
+private:
+    uint32_t _failures = 0;
+    steady_clock::time_point _nextAttempt;
+    minstd_rand _random{random_device{}()};
+
+public:
+    bool Ready(steady_clock::time_point now = steady_clock::now()) const
+    {
+        return now >= _nextAttempt;
+    }
+
+    steady_clock::duration Remaining(steady_clock::time_point now = steady_clock::now()) const
+    {
+        return max<steady_clock::duration>(_nextAttempt - now, 0ms);
+    }
+
+    uint32_t Failures() const
+    {
+        return _failures;
+    }
+
+    void Attempted(steady_clock::time_point now = steady_clock::now())
+    {
+        _nextAttempt = now + kBaseDelay;
+    }
+
+    void Failed(steady_clock::time_point now = steady_clock::now())
+    {
+        auto delay = min<milliseconds>(kBaseDelay * (1u << min<uint32_t>(_failures, 6)), kMaxDelay);
+        _failures++;
+
+        uniform_int_distribution<int64_t> jitter(delay.count() / 2, delay.count());
+        _nextAttempt = now + milliseconds(jitter(_random));
+    }
+
+    void Succeeded()
+    {
+        _failures = 0;
+    }
+};
+
 // ClientResponse
 //
 // Response data sent back to server every time we receive a packet.
@@ -229,12 +291,19 @@ struct ClientResponse
 // pops them off the queue and sends them on a worker thread. The worker thread will attempt
 // to connect to the client if it is not already connected. The worker thread will also
 // attempt to reconnect if the connection is lost.
+//
+// When the shared SocketReactor is enabled, the channel doesn't get a worker thread at all.
+// Instead it registers with one of the reactor's loops and does the same work from there,
+// driven by socket readiness rather than polling.
 
-class SocketChannel : public ISocketChannel
+class SocketChannel : public ISocketChannel, public IReactorHandler
 {
     static constexpr uint16_t CommandPixelData = 3;
     static constexpr size_t MaxQueueDepth = 500;
     static constexpr size_t MaxQueuedBytes = 1024 * 1024 * 10;  // 10MB memory limit
+    static constexpr size_t MaxBatchFrames = 64;                // Upper bound on frames per sendmsg
+    static constexpr uint32_t DefaultBatchBytes = 64 * 1024;
+    static constexpr auto ResponsePollInterval = 1000ms;
 
     string _hostName;
     string _friendlyName;
@@ -244,7 +313,6 @@ class SocketChannel : public ISocketChannel
     uint32_t _id;
 
     mutable mutex _mutex;                       //
-    mutable mutex _queueMutex;
     mutable mutex _responseMutex;
 
     atomic<bool> _isConnected;
@@ -254,7 +322,7 @@ class SocketChannel : public ISocketChannel
 
     ClientResponse _lastClientResponse;
     system_clock::time_point _lastResponseTime;
-    system_clock::time_point _lastConnectionAttempt;
+    ReconnectBackoff _backoff;                  // Only touched by the consumer
     SpeedTracker _speedTracker;
 
     uint32_t _reconnectCount;
@@ -262,10 +330,32 @@ class SocketChannel : public ISocketChannel
     string _lastSocketError;
     system_clock::time_point _lastInvalidByteWarning;
 
-    queue<vector<uint8_t>> _frameQueue;
-    size_t _totalQueuedBytes;  // Track total memory usage
+    FrameRing _frameQueue;                      // Producer is EnqueueFrame, consumer is the worker/reactor
+    size_t _sendOffset = 0;                     // Bytes of the frame at the front of the queue already sent
+    atomic<uint32_t> _batchMaxFrames = 1;
+    atomic<uint32_t> _batchMaxBytes = DefaultBatchBytes;
+    atomic<int> _sendBufferSize = 0;            // 0 leaves the kernel's default
+    atomic<bool> _resetRequested = false;       // Set by the producer, acted upon by the consumer
+    atomic<bool> _trimRequested = false;        // Likewise
+    atomic<BackpressurePolicy> _backpressurePolicy = BackpressurePolicy::Reset;
+    atomic<uint64_t> _droppedFrames = 0;
+    FlowController _flowControl;
+    atomic<uint64_t> _throttledFrames = 0;
+    atomic<uint64_t> _sentFrames = 0;
+    FrameEncoder _encoder;                      // Used by CompressFrame on the producer side
+    atomic<bool> _wakePending = false;          // The consumer has been signaled and not yet run
+    WakeEvent _wake;                            // Signaled to wake the worker thread
     thread _workerThread;
 
+    // Reactor mode state.  Apart from the flags, these are only touched on the reactor thread.
+
+    atomic<ReactorLoop *> _reactorLoop = nullptr;
+    uint64_t _reactorToken = 0;
+    int _connectingFd = -1;
+    steady_clock::time_point _connectStarted;
+    steady_clock::time_point _sendStarted;
+    steady_clock::time_point _lastPollTime;
+    bool _writeArmed = false;
 
 public:
     SocketChannel(const string& hostName, const string& friendlyName, uint16_t port = 49152)
@@ -277,12 +367,11 @@ public:
           _running(false),
           _socketFd(-1),
           _lastClientResponse(),
-          _lastConnectionAttempt(system_clock::now()),
           _reconnectCount(0),
           _failedConnectCount(0),
           _lastSocketError(),
           _lastInvalidByteWarning(system_clock::now() - 60s),
-          _totalQueuedBytes(0)
+          _frameQueue(MaxQueueDepth, MaxQueuedBytes)
     {
     }
 
@@ -297,10 +386,33 @@ public:
         return _id;
     }
 
+    // NextId
+    //
+    // Socket ids are unique across all channel types, so other channels take theirs from here
+
+    static uint32_t NextId()
+    {
+        return _nextId++;
+    }
+
+    SocketTransport Transport() const override
+    {
+        return SocketTransport::Tcp;
+    }
+
+    uint64_t GetSentFrameCount() const override
+    {
+        return _sentFrames;
+    }
+
+    uint64_t GetLostFrameCount() const override
+    {
+        return 0;       // TCP doesn't lose frames, it resets
+    }
+
     size_t GetCurrentQueueDepth() const override
     {
-        lock_guard lock(_queueMutex);
-        return _frameQueue.size();
+        return _frameQueue.Size();
     }
 
     size_t GetQueueMaxSize() const override
@@ -308,6 +420,83 @@ public:
         return MaxQueueDepth;
     }
 
+    // SetBatchLimits
+    //
+    // When more than one frame is waiting, up to maxFrames of them (but no more than maxBytes,
+    // unless a single frame is larger than that) are handed to the kernel in one sendmsg call
+    // straight from the queue.  A maxFrames of 1 sends every frame on its own.
+
+    void SetBatchLimits(uint32_t maxFrames, uint32_t maxBytes) override
+    {
+        _batchMaxFrames = clamp<uint32_t>(maxFrames, 1, MaxBatchFrames);
+        _batchMaxBytes = max<uint32_t>(maxBytes, 1);
+    }
+
+    // SetSendBufferSize
+    //
+    // Sets SO_SNDBUF on sockets opened from now on.  A smaller buffer holds fewer frames in the
+    // kernel where backpressure can't reach them; 0 leaves the kernel's default.
+
+    void SetSendBufferSize(int bytes)
+    {
+        _sendBufferSize = max(bytes, 0);
+    }
+
+    uint32_t GetBatchMaxFrames() const override
+    {
+        return _batchMaxFrames;
+    }
+
+    uint32_t GetBatchMaxBytes() const override
+    {
+        return _batchMaxBytes;
+    }
+
+    void SetBackpressurePolicy(BackpressurePolicy policy) override
+    {
+        _backpressurePolicy = policy;
+    }
+
+    BackpressurePolicy GetBackpressurePolicy() const override
+    {
+        return _backpressurePolicy;
+    }
+
+    uint64_t GetDroppedFrameCount() const override
+    {
+        return _droppedFrames;
+    }
+
+    // SetFlowControl
+    //
+    // With flow control enabled, the channel uses the buffer levels its client reports to only
+    // send as many of the frames it's given as will keep the client's buffer at targetFill.
+
+    void SetFlowControl(bool enabled, double targetFill) override
+    {
+        _flowControl.Configure(enabled, targetFill);
+    }
+
+    bool IsFlowControlEnabled() const override
+    {
+        return _flowControl.IsEnabled();
+    }
+
+    double GetFlowTargetFill() const override
+    {
+        return _flowControl.TargetFill();
+    }
+
+    double GetSendRatio() const override
+    {
+        return _flowControl.SendRatio();
+    }
+
+    uint64_t GetThrottledFrameCount() const override
+    {
+        return _throttledFrames;
+    }
+
     uint32_t GetReconnectCount() const override
     {
         lock_guard lock(_mutex);
@@ -340,11 +529,37 @@ public:
     {
         logger->debug("Starting socket channel for {} [{}]", _hostName, _friendlyName);
 
-        lock_guard lock(_mutex);
-        if (!_running)
+        ReactorLoop * loop = nullptr;
         {
+            lock_guard lock(_mutex);
+            if (_running)
+                return;
+
             _running = true;
-            _workerThread = thread(&SocketChannel::WorkerLoop, this);
+            if (SocketReactor::Instance().IsEnabled())
+            {
+                loop = &SocketReactor::Instance().AcquireLoop();
+                _reactorToken = ReactorLoop::NextToken();
+                _reactorLoop = loop;
+            }
+            else
+            {
+                _workerThread = thread(&SocketChannel::WorkerLoop, this);
+            }
+        }
+
+        // Handlers run with the loop's dispatch mutex held and take _mutex, so attaching has to
+        // happen outside _mutex to keep the two always locked in that order.  A frame queued
+        // before the handler was attached had its wake dropped, and a wake from before the last
+        // Stop never ran at all, so either way the flag is cleared and any waiting frames are
+        // signaled again.
+
+        if (loop)
+        {
+            loop->Attach(_reactorToken, this);
+            _wakePending = false;
+            if (!_frameQueue.Empty())
+                WakeConsumer();
         }
     }
 
@@ -356,10 +571,23 @@ public:
             _running = false;
         }
 
+        _wake.Signal();
         if (_workerThread.joinable())
             _workerThread.join();
 
+        // Once Detach returns the reactor thread can no longer be in OnReactorEvent reopening
+        // the socket, so only then is _socketFd safe to read and unwatch
+
+        if (auto loop = _reactorLoop.load())
+        {
+            loop->Detach(_reactorToken);
+            AbandonConnect();
+            CloseSocket();
+            _reactorLoop = nullptr;
+        }
+
         CloseSocket();
+        _wakePending = false;
     }
 
     bool IsConnected() const override
@@ -388,58 +616,150 @@ public:
 
     // CompressFrame
     //
-    // Takes a frame of binary data, compresses it, and inserts a small header
-    // in front of it with a magic number and the size of the compressed data.
+    // Encodes a data frame with the channel's codec, by default compressing it and inserting a
+    // small header in front of it with a magic number and the size of the compressed data.
 
-    vector<uint8_t> CompressFrame(const vector<uint8_t>& data) override
+    FramePtr CompressFrame(const uint8_t * data, size_t size, size_t headerSize = 0, uint64_t pixelHash = 0) override
     {
-        constexpr uint32_t COMPRESSED_HEADER_TAG = 0x44415645; // Magic "DAVE" tag
-        constexpr uint32_t CUSTOM_TAG = 0x12345678;
+        return _encoder.Encode(data, size, EncoderEpoch(), headerSize, pixelHash);
+    }
 
-        // Compress the data
-        auto compressedData = Utilities::Compress(data);
+    // ShouldSendFrame
+    //
+    // Asked before building a frame whose pixels have the given hash; false means the frame
+    // would be a repeat and skipping unchanged frames is enabled
 
-        // Create the compressed frame
-        return Utilities::CombineByteArrays(
-            Utilities::DWORDToBytes(COMPRESSED_HEADER_TAG),
-            Utilities::DWORDToBytes(static_cast<uint32_t>(compressedData.size())),
-            Utilities::DWORDToBytes(static_cast<uint32_t>(data.size())),
-            Utilities::DWORDToBytes(CUSTOM_TAG),
-            std::move(compressedData)
-        );
+    bool ShouldSendFrame(uint64_t pixelHash) override
+    {
+        return _encoder.ShouldEncode(pixelHash, EncoderEpoch());
     }
 
-bool EnqueueFrame(vector<uint8_t>&& frameData) override
-{
-    bool isQueueFull = false;
-    {
-        lock_guard lock(_queueMutex);
-        size_t newTotalBytes = _totalQueuedBytes + frameData.size();
-        if (_frameQueue.size() >= MaxQueueDepth || newTotalBytes > MaxQueuedBytes)
-            isQueueFull = true;
-        else {
-            _totalQueuedBytes += frameData.size();
-            _frameQueue.push(std::move(frameData));
-        }
+    void SetSkipUnchanged(bool enabled, milliseconds keepalive) override
+    {
+        _encoder.SetSkipUnchanged(enabled, keepalive);
     }
 
-    // If the queue is full, we reset the socket and drop the frames in the queue
+    bool IsSkipUnchangedEnabled() const override
+    {
+        return _encoder.SkipUnchanged();
+    }
 
-    if (isQueueFull)
+    milliseconds GetKeepaliveInterval() const override
     {
-        logger->debug("Queue is full at {} [{}] dropping frame and resetting socket", _hostName, _friendlyName);
-        CloseSocket();
-        EmptyQueue();
-        return false;
+        return _encoder.Keepalive();
     }
 
-    return true;
-}
+    uint64_t GetSkippedFrameCount() const override
+    {
+        return _encoder.SkippedFrames();
+    }
+
+    void RecordEncodeTime(nanoseconds elapsed) override
+    {
+        _encoder.RecordEncodeTime(elapsed);
+    }
+
+    double GetLastEncodeMicros() const override
+    {
+        return _encoder.LastEncodeMicros();
+    }
+
+    double GetAverageEncodeMicros() const override
+    {
+        return _encoder.AverageEncodeMicros();
+    }
+
+    void SetCodec(FrameCodec codec, int level) override
+    {
+        _encoder.Configure(codec, level);
+    }
+
+    FrameCodec GetCodec() const override
+    {
+        return _encoder.Codec();
+    }
+
+    int GetCompressionLevel() const override
+    {
+        return _encoder.Level();
+    }
+
+    FrameCodec GetActiveCodec() const override
+    {
+        return _encoder.ActiveCodec();
+    }
+
+    double GetCompressionRatio() const override
+    {
+        return _encoder.Ratio();
+    }
+
+    // EnqueueFrame
+    //
+    // Queues a frame for sending.  The timestamp is the time the frame was rendered for, and is
+    // what the LatestWins policy uses to decide whether a frame is late.
+    //
+    // If the queue is full the frame is dropped, and what else happens depends on the policy.
+    // Both the socket and the consuming end of the queue belong to the worker thread or reactor,
+    // so we only flag what needs doing here and let the consumer carry it out.
+
+    bool EnqueueFrame(vector<uint8_t>&& frameData, system_clock::time_point timestamp = system_clock::time_point()) override
+    {
+        return EnqueueFrame(make_shared<const vector<uint8_t>>(std::move(frameData)), timestamp);
+    }
+
+    bool EnqueueFrame(FramePtr frame, system_clock::time_point timestamp = system_clock::time_point()) override
+    {
+        if (!_flowControl.Admit())
+        {
+            _throttledFrames++;
+            return false;
+        }
+
+        if (_frameQueue.TryPush(std::move(frame), timestamp))
+        {
+            WakeConsumer();
+            return true;
+        }
+
+        _droppedFrames++;
+
+        switch (_backpressurePolicy.load())
+        {
+            case BackpressurePolicy::Reset:
+                logger->debug("Queue is full at {} [{}] dropping frame and resetting socket", _hostName, _friendlyName);
+                _resetRequested = true;
+                break;
+
+            case BackpressurePolicy::DropNewest:
+                return false;
+
+            default:
+                _trimRequested = true;
+                break;
+        }
+
+        WakeConsumer();
+        return false;
+    }
 
 private:
 
+    // EncoderEpoch
+    //
+    // Changes whenever a frame may not have reached the client: it was throttled, dropped, or
+    // the connection it was sent on went away
+
+    uint64_t EncoderEpoch() const
+    {
+        return _droppedFrames + _throttledFrames + GetReconnectCount();
+    }
+
     void RecordConnectFailure(const string& error)
     {
+        _backoff.Failed();
+        HostResolver::Instance().Forget(_hostName);
+
         lock_guard lock(_mutex);
         _isConnected = false;
         _failedConnectCount++;
@@ -448,6 +768,8 @@ private:
 
     void RecordConnectSuccess()
     {
+        _backoff.Succeeded();
+
         lock_guard lock(_mutex);
         _isConnected = true;
         _reconnectCount++;
@@ -463,52 +785,29 @@ private:
     void WorkerLoop()
     {
         steady_clock::time_point lastPollTime = steady_clock::now();
-        constexpr auto kMaxBatchSize = 1;
-        constexpr auto reconnectDelay = 1000ms;
-        constexpr auto pollInterval = 1000ms;
 
-        vector<uint8_t> combinedBuffer;
-        combinedBuffer.reserve(4096); // Larger reserve for batched frames
         while (_running)
         {
             try
             {
-                size_t packetCount = 0;
                 auto now = steady_clock::now();
 
-                if (!_frameQueue.empty())
+                if (_resetRequested.exchange(false))
                 {
-                    combinedBuffer.clear();
-                    unique_lock<mutex> lock(_queueMutex);
-
-                    while (!_frameQueue.empty() && packetCount < kMaxBatchSize)
-                    {
-                        vector<uint8_t>& frame = _frameQueue.front();
-                        packetCount++;
-                        combinedBuffer.insert(combinedBuffer.end(), frame.begin(), frame.end());
-                        _totalQueuedBytes -= frame.size();
-                        _frameQueue.pop();
-                    }
+                    CloseSocket();
+                    EmptyQueue();
                 }
 
-                if (packetCount > 0)
-                {
-                    SendFrame(std::move(combinedBuffer));
-                }
+                if (!_frameQueue.Empty())
+                    SendBatch();
 
                 // Check for responses much less frequently
-                if (now - lastPollTime >= pollInterval)
+                if (now - lastPollTime >= ResponsePollInterval)
                 {
                     lastPollTime = now;
                     _speedTracker.UpdateBytesPerSecond();
 
-                    optional<ClientResponse> response = ReadSocketResponse();
-                    if (response)
-                    {
-                        lock_guard lock(_responseMutex);
-                        _lastClientResponse = std::move(*response);
-                        _lastResponseTime = system_clock::now();
-                    }
+                    UpdateClientResponse(ReadSocketResponse());
                 }
             }
             catch (const exception& e)
@@ -516,19 +815,270 @@ private:
                 logger->warn("SocketChannel WorkerLoop exception: {}", e.what());
                 CloseSocket();
 
-                auto nowUs = system_clock::now();
-                if (duration_cast<microseconds>(nowUs - _lastConnectionAttempt) < reconnectDelay)
+                if (!_backoff.Ready())
                 {
-                    this_thread::sleep_for(reconnectDelay - (nowUs - _lastConnectionAttempt));
+                    this_thread::sleep_for(min<steady_clock::duration>(_backoff.Remaining(), ReconnectBackoff::kBaseDelay));
                     continue;
                 }
             }
 
-            this_thread::sleep_for(1ms);
+            WaitForWork(lastPollTime + ResponsePollInterval - steady_clock::now());
+        }
+    }
+
+    // WakeConsumer
+    //
+    // Lets whoever drains the queue know there's work to do.  Only the first call after the
+    // consumer last ran actually signals anything, so a burst of frames costs one wakeup.
+
+    void WakeConsumer()
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (_wakePending.exchange(true))
+            return;
+
+        if (auto loop = _reactorLoop.load())
+            loop->Wake(_reactorToken);
+        else
+            _wake.Signal();
+    }
+
+    // WaitForWork
+    //
+    // Thread mode; sleeps until EnqueueFrame wakes us, the client sends something, or the
+    // timeout expires.  Returns right away if there's already something to do.
+
+    void WaitForWork(steady_clock::duration timeout)
+    {
+        _wakePending = false;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!_frameQueue.Empty() || _resetRequested || !_running)
+            return;
+
+        pollfd fds[2] = {};
+        fds[0].fd = _wake.Fd();
+        fds[0].events = POLLIN;
+        fds[1].fd = _socketFd;
+        fds[1].events = POLLIN;
+        nfds_t count = _socketFd != -1 ? 2 : 1;
+
+        auto ms = duration_cast<milliseconds>(timeout).count();
+        if (poll(fds, count, static_cast<int>(clamp<int64_t>(ms, 0, ResponsePollInterval.count()))) <= 0)
+            return;
+
+        if (fds[0].revents)
+            _wake.Drain();
+
+        if (count == 2 && fds[1].revents)
+        {
+            bool peerClosed = (fds[1].revents & (POLLERR | POLLHUP)) != 0;
+            UpdateClientResponse(ReadSocketResponse(&peerClosed));
+            if (peerClosed)
+            {
+                logger->debug("Connection closed by {} [{}]", _hostName, _friendlyName);
+                CloseSocket();
+            }
         }
     }
 
-    optional<ClientResponse> ReadSocketResponse()
+    // OnReactorEvent
+    //
+    // The reactor mode equivalent of WorkerLoop.  Runs on the reactor thread that owns this
+    // channel whenever the socket becomes readable or writable, EnqueueFrame wakes us, or the
+    // reactor ticks.  Nothing in here may block.
+
+    void OnReactorEvent(uint32_t events) override
+    {
+        // Cleared even when stopping, or the next Start would inherit a wake that never runs
+        if (events & Wake)
+        {
+            _wakePending = false;
+            atomic_thread_fence(memory_order_seq_cst);
+        }
+
+        if (!_running)
+            return;
+
+        try
+        {
+            if (_resetRequested.exchange(false))
+            {
+                AbandonConnect();
+                CloseReactorSocket();
+                EmptyQueue();
+            }
+
+            if (_connectingFd != -1)
+            {
+                if (events & (Writable | Hangup))
+                    CompleteReactorConnect();
+                else if (steady_clock::now() - _connectStarted >= kConnectTimeout)
+                {
+                    logger->debug("Connection timeout to {} [{}]", _hostName, _friendlyName);
+                    RecordConnectFailure("connection timeout");
+                    AbandonConnect();
+                }
+            }
+            else if (_socketFd != -1 && (events & (Readable | Hangup)))
+            {
+                bool peerClosed = (events & Hangup) != 0;
+                UpdateClientResponse(ReadSocketResponse(&peerClosed));
+                if (peerClosed)
+                {
+                    logger->debug("Connection closed by {} [{}]", _hostName, _friendlyName);
+                    CloseReactorSocket();
+                }
+            }
+
+            // Like the worker thread, we only try to connect when there's something to send.
+            // Frames that arrive while we're backing off are dropped, just as they would be by
+            // a failed SendBatch.
+
+            if (_socketFd == -1 && _connectingFd == -1 && !_frameQueue.Empty())
+            {
+                if (_backoff.Ready())
+                    BeginReactorConnect();
+                else
+                    EmptyQueue();
+            }
+
+            if (_socketFd != -1)
+                DrainQueue();
+
+            if (events & Tick)
+            {
+                auto now = steady_clock::now();
+                if (now - _lastPollTime >= ResponsePollInterval)
+                {
+                    _lastPollTime = now;
+                    _speedTracker.UpdateBytesPerSecond();
+                }
+            }
+        }
+        catch (const exception& e)
+        {
+            logger->warn("SocketChannel reactor exception: {}", e.what());
+            AbandonConnect();
+            CloseReactorSocket();
+        }
+    }
+
+    void BeginReactorConnect()
+    {
+        bool inProgress = false;
+        int tempSocket = OpenSocket(inProgress);
+        if (tempSocket == -1)
+            return;
+
+        if (!inProgress)
+        {
+            if (FinishConnect(tempSocket))
+                _reactorLoop.load()->Watch(_reactorToken, _socketFd, false);
+            return;
+        }
+
+        _connectingFd = tempSocket;
+        _connectStarted = steady_clock::now();
+        _reactorLoop.load()->Watch(_reactorToken, _connectingFd, true);
+    }
+
+    void CompleteReactorConnect()
+    {
+        int tempSocket = _connectingFd;
+        _connectingFd = -1;
+        _reactorLoop.load()->Unwatch(tempSocket);
+
+        if (FinishConnect(tempSocket))
+            _reactorLoop.load()->Watch(_reactorToken, _socketFd, false);
+        _writeArmed = false;
+    }
+
+    void AbandonConnect()
+    {
+        if (_connectingFd == -1)
+            return;
+
+        if (auto loop = _reactorLoop.load())
+            loop->Unwatch(_connectingFd);
+        close(_connectingFd);
+        _connectingFd = -1;
+    }
+
+    void CloseReactorSocket()
+    {
+        CloseSocket();
+        _writeArmed = false;
+    }
+
+    void ArmWrite(bool wantWrite)
+    {
+        if (_writeArmed == wantWrite)
+            return;
+
+        _writeArmed = wantWrite;
+        _reactorLoop.load()->Watch(_reactorToken, _socketFd, wantWrite);
+    }
+
+    // DrainQueue
+    //
+    // Sends as much of the queue as the socket will take without blocking.  If the socket fills
+    // up part way through a frame we ask to be told when it is writable again; if that doesn't
+    // happen within the send timeout, we give up on the connection.
+
+    void DrainQueue()
+    {
+        while (_socketFd != -1)
+        {
+            if (_frameQueue.Empty())
+            {
+                ArmWrite(false);
+                return;
+            }
+
+            // The timeout runs from the last time the socket made progress
+
+            if (!_writeArmed)
+                _sendStarted = steady_clock::now();
+
+            size_t framesSent = 0;
+            ssize_t sent = SendQueuedFrames(framesSent);
+            if (sent > 0 || framesSent > 0)
+            {
+                _sendStarted = steady_clock::now();
+                continue;
+            }
+
+            if (sent == -1 && (errno == EWOULDBLOCK || errno == EAGAIN))
+            {
+                if (steady_clock::now() - _sendStarted >= kSendTimeout)
+                {
+                    logger->warn("Socket timed out for {} [{}]", _hostName, _friendlyName);
+                    CloseReactorSocket();
+                    return;
+                }
+                ArmWrite(true);
+                return;
+            }
+
+            logger->debug("Send failed for {} [{}] errno={}", _hostName, _friendlyName, errno);
+            CloseReactorSocket();
+            return;
+        }
+    }
+
+    void UpdateClientResponse(optional<ClientResponse> response)
+    {
+        if (!response)
+            return;
+
+        _flowControl.OnClientResponse(response->bufferPos, response->bufferSize, _frameQueue.Size());
+
+        lock_guard lock(_responseMutex);
+        _lastClientResponse = std::move(*response);
+        _lastResponseTime = system_clock::now();
+    }
+
+    optional<ClientResponse> ReadSocketResponse(bool * pPeerClosed = nullptr)
     {
         const size_t cbToRead = sizeof(ClientResponse);
         optional<ClientResponse> lastResponse;
@@ -543,7 +1093,11 @@ private:
             uint8_t byteCount = 0;
             ssize_t readBytes = recv(_socketFd, &byteCount, 1, MSG_PEEK);
             if (readBytes <= 0)
+            {
+                if (readBytes == 0 && pPeerClosed)
+                    *pPeerClosed = true;
                 break;
+            }
 
             if (byteCount != static_cast<uint8_t>(cbToRead))
             {
@@ -569,9 +1123,10 @@ private:
                     logger->warn("Invalid byte count ({}) reading response from {} [{}]", byteCount, _hostName, _friendlyName);
                     _lastInvalidByteWarning = now;
                 }
-                // Invalid byte count; eat the contents
-                vector<uint8_t> tempBuffer(byteCount);
-                recv(_socketFd, tempBuffer.data(), byteCount, 0);
+                // Invalid byte count; eat the contents (at least one byte, so a stray zero
+                // can't keep us spinning here)
+                vector<uint8_t> tempBuffer(max<size_t>(byteCount, 1));
+                recv(_socketFd, tempBuffer.data(), tempBuffer.size(), 0);
                 continue;  // Check for more data
             }
 
@@ -629,6 +1184,13 @@ private:
             return false;
         }
 
+        int sendBufferSize = _sendBufferSize;
+        if (sendBufferSize > 0 && setsockopt(socketFd, SOL_SOCKET, SO_SNDBUF, &sendBufferSize, sizeof(sendBufferSize)) < 0)
+        {
+            logger->warn("Could not set TCP send buffer size for {} [{}]", _hostName, _friendlyName);
+            return false;
+        }
+
         struct timeval timeouttv;
         timeouttv.tv_sec = kSendTimeout.count() / 1000;
         timeouttv.tv_usec = (kSendTimeout.count() % 1000) * 1000;
@@ -642,29 +1204,168 @@ private:
         return true;
     }
 
-    void SendFrame(const vector<uint8_t>&& frame)
+    // SendQueuedFrames
+    //
+    // Hands up to one batch of queued frames to the kernel with a single sendmsg, directly from
+    // the queue's buffers.  Frames that went out completely are popped and counted in
+    // framesSent; if the last one only went out in part, _sendOffset remembers how far we got.
+    // Returns whatever sendmsg returned.
+
+    ssize_t SendQueuedFrames(size_t & framesSent)
     {
-        if (_socketFd == -1 && !ConnectSocket())
+        iovec iov[MaxBatchFrames];
+        const size_t maxFrames = ApplyBackpressure() ? 1 : _batchMaxFrames.load();
+        const size_t maxBytes = _batchMaxBytes;
+
+        size_t count = 0;
+        size_t bytes = 0;
+        while (count < maxFrames)
         {
-            logger->debug("Could not connect to {} [{}] in SendFrame", _hostName, _friendlyName);
-            lock_guard lock(_mutex);
-            _isConnected = false;
-            return;
+            auto * frame = _frameQueue.Peek(count);
+            if (!frame)
+                break;
+
+            size_t skip = (count == 0) ? _sendOffset : 0;
+            size_t length = frame->size() - skip;
+            if (count > 0 && bytes + length > maxBytes)
+                break;
+
+            iov[count].iov_base = const_cast<uint8_t *>(frame->data()) + skip;
+            iov[count].iov_len = length;
+            bytes += length;
+            count++;
+        }
+
+        framesSent = 0;
+        if (count == 0)
+            return 0;
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        ssize_t sent = sendmsg(_socketFd, &msg, MSG_NOSIGNAL);
+        if (sent < 0)
+            return sent;
+
+        _speedTracker.AddBytes(sent);
+
+        size_t remaining = sent;
+        for (auto * frame = _frameQueue.Peek(); frame && framesSent < count; frame = _frameQueue.Peek())
+        {
+            size_t unsent = frame->size() - _sendOffset;
+            if (remaining < unsent)
+            {
+                _sendOffset += remaining;
+                break;
+            }
+
+            remaining -= unsent;
+            _sendOffset = 0;
+            _frameQueue.Pop();
+            framesSent++;
         }
+        _sentFrames += framesSent;
 
-        size_t totalSent = 0;
-        while (totalSent < frame.size() && _running)
+        return sent;
+    }
+
+    // ApplyBackpressure
+    //
+    // The consumer's half of the backpressure policy.  Frames are only ever dropped from the
+    // front of the queue, and never the newest one.  A frame we've started sending can't be
+    // dropped either, so if that's in the way we return true to ask the caller to finish just
+    // that frame first.
+
+    bool ApplyBackpressure()
+    {
+        const bool trimRequested = _trimRequested.exchange(false);
+        const auto policy = _backpressurePolicy.load();
+
+        // Keep the queue under three quarters of its limits for DropOldest, so that there's
+        // usually room for the producer and it's the old frames that get dropped, not new ones.
+        // For LatestWins, frames whose time has passed would only be shown late, so skip ahead
+        // to the newest one; if the queue overflowed we skip ahead regardless.
+
+        const size_t maxFrames = _frameQueue.Capacity() * 3 / 4;
+        const size_t maxBytes = _frameQueue.MaxBytes() * 3 / 4;
+        const auto now = system_clock::now();
+
+        auto shouldDrop = [&]()
+        {
+            switch (policy)
+            {
+                case BackpressurePolicy::DropOldest:
+                    return _frameQueue.Size() > maxFrames || _frameQueue.QueuedBytes() > maxBytes;
+                case BackpressurePolicy::LatestWins:
+                    return trimRequested || _frameQueue.Timestamp() < now;
+                default:
+                    return false;
+            }
+        };
+
+        size_t dropped = 0;
+        bool blocked = false;
+
+        while (_frameQueue.Peek(1) && shouldDrop())
         {
-            auto startTime = steady_clock::now();
+            if (_sendOffset != 0)
+            {
+                blocked = true;
+                break;
+            }
+            _frameQueue.Pop();
+            dropped++;
+        }
+
+        if (blocked && trimRequested)
+            _trimRequested = true;
+
+        _droppedFrames += dropped;
+        return blocked;
+    }
 
-            ssize_t sent = send(_socketFd,
-                            frame.data() + totalSent,
-                            frame.size() - totalSent,
-                            MSG_NOSIGNAL);
+    // SendBatch
+    //
+    // Thread mode; sends the next batch of queued frames, connecting first if need be.  Blocks
+    // until the batch is out, the send times out, or the channel is stopped.
+
+    void SendBatch()
+    {
+        // Frames that arrive while we're backing off, or that we couldn't connect for, are
+        // dropped; by the time we'd get them out they'd be stale anyway
 
-            if (sent > 0)
+        if (_socketFd == -1)
+        {
+            if (!_backoff.Ready())
             {
-                totalSent += sent;
+                EmptyQueue();
+                return;
+            }
+
+            if (!ConnectSocket())
+            {
+                logger->debug("Could not connect to {} [{}] in SendBatch", _hostName, _friendlyName);
+                EmptyQueue();
+                lock_guard lock(_mutex);
+                _isConnected = false;
+                return;
+            }
+        }
+
+        const size_t batchFrames = min<size_t>(_frameQueue.Size(), _batchMaxFrames);
+        size_t totalFrames = 0;
+        auto startTime = steady_clock::now();
+
+        while (totalFrames < batchFrames && !_frameQueue.Empty() && _running)
+        {
+            size_t framesSent = 0;
+            ssize_t sent = SendQueuedFrames(framesSent);
+
+            if (sent > 0 || framesSent > 0)
+            {
+                totalFrames += framesSent;
+                startTime = steady_clock::now();
                 continue;
             }
 
@@ -680,9 +1381,15 @@ private:
                     continue;
                 }
 
-                if ((errno == EWOULDBLOCK || errno == EAGAIN) && ((steady_clock::now() - startTime) < kSendTimeout))
+                // The socket is full; wait for the client to drain it rather than spinning
+
+                auto remaining = kSendTimeout - (steady_clock::now() - startTime);
+                if ((errno == EWOULDBLOCK || errno == EAGAIN) && remaining > 0ms)
                 {
-                    this_thread::sleep_for(1ms);
+                    pollfd pfd;
+                    pfd.fd = _socketFd;
+                    pfd.events = POLLOUT;
+                    poll(&pfd, 1, static_cast<int>(duration_cast<milliseconds>(remaining).count()) + 1);
                     continue;
                 }
                 logger->warn("Socket timed out for {} [{}] errno={}", _hostName, _friendlyName, errno);
@@ -692,38 +1399,50 @@ private:
             }
         }
 
-        {
-            lock_guard lock(_mutex);
-            _isConnected = true;
-            _speedTracker.AddBytes(totalSent);
-        }
+        lock_guard lock(_mutex);
+        _isConnected = true;
     }
 
+    // OpenSocket
+    //
+    // Creates a non-blocking socket and starts connecting it to the client.  Returns the socket,
+    // or -1 on failure.  If the connect is still in progress, inProgress is set and the caller
+    // has to wait for the socket to become writable before calling FinishConnect.  If the host
+    // name is still being resolved, -1 is returned without that counting as a failure.
 
-    bool ConnectSocket()
+    int OpenSocket(bool & inProgress)
     {
-        logger->debug("Attempting to connect to {} [{}]", _hostName, _friendlyName);
-
-        _lastConnectionAttempt = system_clock::now();
-
-        int tempSocket = socket(AF_INET, SOCK_STREAM, 0);
-        if (tempSocket == -1)
-        {
-            RecordConnectFailure("socket failed: " + string(strerror(errno)));
-            return false;
-        }
+        inProgress = false;
 
         struct sockaddr_in serverAddr;
         memset(&serverAddr, 0, sizeof(serverAddr));
         serverAddr.sin_family = AF_INET;
         serverAddr.sin_port = htons(_port);
 
-        if (inet_pton(AF_INET, _hostName.c_str(), &serverAddr.sin_addr) <= 0)
+        string resolveError;
+        switch (HostResolver::Instance().Lookup(_hostName, serverAddr.sin_addr, resolveError))
         {
-            logger->warn("Invalid address for {} [{}]", _hostName, _friendlyName);
-            RecordConnectFailure("invalid address: " + _hostName);
-            close(tempSocket);
-            return false;
+            case HostResolver::Status::Pending:
+                logger->debug("Still resolving {} [{}]", _hostName, _friendlyName);
+                return -1;
+
+            case HostResolver::Status::Failed:
+                logger->debug("Could not resolve {} [{}]", _hostName, _friendlyName);
+                RecordConnectFailure(resolveError);
+                return -1;
+
+            case HostResolver::Status::Resolved:
+                break;
+        }
+
+        logger->debug("Attempting to connect to {} [{}]", _hostName, _friendlyName);
+        _backoff.Attempted();
+
+        int tempSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (tempSocket == -1)
+        {
+            RecordConnectFailure("socket failed: " + string(strerror(errno)));
+            return -1;
         }
 
         // Set socket options (non-blocking, keepalive, send timeout)
@@ -732,7 +1451,7 @@ private:
             logger->warn("Could not set socket options for {} [{}]", _hostName, _friendlyName);
             RecordConnectFailure("could not set socket options");
             close(tempSocket);
-            return false;
+            return -1;
         }
 
         // Non-blocking connect
@@ -744,36 +1463,34 @@ private:
                 logger->debug("Could not connect to {} [{}] errno={}", _hostName, _friendlyName, errno);
                 RecordConnectFailure("connect failed: " + string(strerror(errno)));
                 close(tempSocket);
-                return false;
+                return -1;
             }
+            inProgress = true;
+        }
 
-            // Wait for connection with timeout
-            pollfd pfd;
-            pfd.fd = tempSocket;
-            pfd.events = POLLOUT;
+        return tempSocket;
+    }
 
-            if (poll(&pfd, 1, kConnectTimeout.count()) <= 0)
-            {
-                logger->debug("Connection timeout to {} [{}]", _hostName, _friendlyName);
-                RecordConnectFailure("connection timeout");
-                close(tempSocket);
-                return false;
-            }
+    // FinishConnect
+    //
+    // Checks whether a connect started by OpenSocket succeeded and, if so, makes the socket the
+    // channel's active one.  Closes the socket on failure.
 
-            // Check if connection was successful
-            int error = 0;
-            socklen_t len = sizeof(error);
-            if (getsockopt(tempSocket, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0)
-            {
-                RecordConnectFailure(error == 0
-                    ? "connect status failed: " + string(strerror(errno))
-                    : "connect failed: " + string(strerror(error)));
-                close(tempSocket);
-                return false;
-            }
+    bool FinishConnect(int tempSocket)
+    {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(tempSocket, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0)
+        {
+            RecordConnectFailure(error == 0
+                ? "connect status failed: " + string(strerror(errno))
+                : "connect failed: " + string(strerror(error)));
+            close(tempSocket);
+            return false;
         }
 
         RecordConnectSuccess();
+        _flowControl.Reset();
         if (GetReconnectCount() == 1)
             logger->info("Connected to {}:{} [{}]", _hostName, _port, _friendlyName);
         else
@@ -783,15 +1500,55 @@ private:
         return true;
     }
 
+    bool ConnectSocket()
+    {
+        bool inProgress = false;
+        int tempSocket = OpenSocket(inProgress);
+        if (tempSocket == -1)
+            return false;
+
+        // Wait for the connection to complete, giving up after the timeout or if the channel is
+        // stopped.  New frames wake us up along the way; they just wait in the queue.
+
+        auto deadline = steady_clock::now() + kConnectTimeout;
+        while (inProgress)
+        {
+            auto remaining = duration_cast<milliseconds>(deadline - steady_clock::now());
+            if (remaining <= 0ms || !_running)
+            {
+                logger->debug("Connection timeout to {} [{}]", _hostName, _friendlyName);
+                RecordConnectFailure(_running ? "connection timeout" : "channel stopped");
+                close(tempSocket);
+                return false;
+            }
+
+            pollfd fds[2] = {};
+            fds[0].fd = tempSocket;
+            fds[0].events = POLLOUT;
+            fds[1].fd = _wake.Fd();
+            fds[1].events = POLLIN;
+
+            if (poll(fds, 2, static_cast<int>(remaining.count()) + 1) > 0)
+            {
+                if (fds[1].revents)
+                    _wake.Drain();
+                if (fds[0].revents)
+                    inProgress = false;
+            }
+        }
+
+        return FinishConnect(tempSocket);
+    }
+
+    // EmptyQueue
+    //
+    // Drops everything in the queue.  Only the consumer may call this.
+
     void EmptyQueue()
     {
         logger->debug("Emptying queue for {} [{}]", _hostName, _friendlyName);
-        scoped_lock lock(_mutex, _queueMutex);
-        while (!_frameQueue.empty()) {
-            _totalQueuedBytes -= _frameQueue.front().size();
-            _frameQueue.pop();
-        }
-        assert(_totalQueuedBytes == 0);
+        _droppedFrames += _frameQueue.Clear();
+        _sendOffset = 0;
     }
 
     void CloseSocket()
@@ -800,10 +1557,15 @@ private:
         lock_guard lock(_mutex);  // Add lock
         if (_socketFd != -1)
         {
+            if (auto loop = _reactorLoop.load())
+                loop->Unwatch(_socketFd);
             close(_socketFd);
             _socketFd = -1;
         }
         _isConnected = false;
+
+        // A frame that was only partly sent goes out again in full on the next connection
+        _sendOffset = 0;
     }
 };
 
@@ -813,6 +1575,7 @@ inline void to_json(nlohmann::json &j, const ISocketChannel & socket)
 {
     try
     {
+        j["transport"] = socket.Transport();
         j["hostName"] = socket.HostName();
         j["friendlyName"] = socket.FriendlyName();
         j["isConnected"] = socket.IsConnected();
@@ -821,6 +1584,25 @@ inline void to_json(nlohmann::json &j, const ISocketChannel & socket)
         j["lastSocketError"] = socket.GetLastSocketError();
         j["queueDepth"] = socket.GetCurrentQueueDepth();
         j["queueMaxSize"] = socket.GetQueueMaxSize();
+        j["batchFrames"] = socket.GetBatchMaxFrames();
+        j["batchBytes"] = socket.GetBatchMaxBytes();
+        j["backpressure"] = socket.GetBackpressurePolicy();
+        j["droppedFrames"] = socket.GetDroppedFrameCount();
+        j["flowControl"] = socket.IsFlowControlEnabled();
+        j["flowTargetFill"] = socket.GetFlowTargetFill();
+        j["sendRatio"] = socket.GetSendRatio();
+        j["throttledFrames"] = socket.GetThrottledFrameCount();
+        j["sentFrames"] = socket.GetSentFrameCount();
+        j["lostFrames"] = socket.GetLostFrameCount();
+        j["codec"] = socket.GetCodec();
+        j["compressionLevel"] = socket.GetCompressionLevel();
+        j["activeCodec"] = socket.GetActiveCodec();
+        j["compressionRatio"] = socket.GetCompressionRatio();
+        j["skipUnchanged"] = socket.IsSkipUnchangedEnabled();
+        j["keepaliveMs"] = socket.GetKeepaliveInterval().count();
+        j["skippedFrames"] = socket.GetSkippedFrameCount();
+        j["encodeMicros"] = socket.GetLastEncodeMicros();
+        j["averageEncodeMicros"] = socket.GetAverageEncodeMicros();
         j["bytesPerSecond"] = socket.GetLastBytesPerSecond();
         j["port"] = socket.Port();
         j["id"] = socket.Id();
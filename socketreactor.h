@@ -0,0 +1,391 @@
+#pragma once
+using namespace std;
+
+// SocketReactor
+//
+// An optional shared I/O engine for SocketChannels.  Rather than every channel owning a worker
+// thread that wakes up every millisecond to look at its queue, a small fixed pool of reactor
+// threads each own an epoll set and service all of the non-blocking sockets assigned to them:
+// they drain a channel's queue when its socket is writable, read client responses when it is
+// readable, and give every channel a periodic tick for housekeeping like reconnects.
+//
+// The reactor is opt-in.  With a thread count of zero (the default), or on platforms without
+// epoll, channels keep using their own worker threads.
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <stdexcept>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+#endif
+
+#include "global.h"
+
+// WakeEvent
+//
+// A file descriptor that can be signaled from any thread to wake up a thread that is waiting
+// on it in poll or epoll.  Uses an eventfd where available and a non-blocking pipe elsewhere.
+
+class WakeEvent
+{
+    int _readFd  = -1;
+    int _writeFd = -1;
+
+public:
+    WakeEvent()
+    {
+        #if defined(__linux__)
+            _readFd = _writeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        #else
+            int fds[2];
+            if (pipe(fds) == 0)
+            {
+                _readFd = fds[0];
+                _writeFd = fds[1];
+                fcntl(_readFd, F_SETFL, fcntl(_readFd, F_GETFL, 0) | O_NONBLOCK);
+                fcntl(_writeFd, F_SETFL, fcntl(_writeFd, F_GETFL, 0) | O_NONBLOCK);
+            }
+        #endif
+
+        if (_readFd == -1)
+            throw runtime_error("Could not create wake event: " + string(strerror(errno)));
+    }
+
+    ~WakeEvent()
+    {
+        close(_readFd);
+        if (_writeFd != _readFd)
+            close(_writeFd);
+    }
+
+    WakeEvent(const WakeEvent&) = delete;
+    WakeEvent& operator=(const WakeEvent&) = delete;
+
+    int Fd() const
+    {
+        return _readFd;
+    }
+
+    // Signal
+    //
+    // If the event is already signaled the write fails with EAGAIN, which is fine; one pending
+    // wakeup is as good as many.
+
+    void Signal()
+    {
+        uint64_t one = 1;
+        ssize_t result = write(_writeFd, &one, _writeFd == _readFd ? sizeof(one) : 1);
+        (void) result;
+    }
+
+    void Drain()
+    {
+        uint64_t value;
+        while (read(_readFd, &value, sizeof(value)) > 0)
+            ;
+    }
+};
+
+// IReactorHandler
+//
+// Implemented by anything that wants to be driven by a ReactorLoop.  All callbacks for a given
+// handler arrive on the same reactor thread, and never after ReactorLoop::Detach has returned.
+
+class IReactorHandler
+{
+public:
+    enum Event : uint32_t
+    {
+        Readable = 0x01,    // The watched socket has data to read
+        Writable = 0x02,    // The watched socket can accept more data
+        Hangup   = 0x04,    // The watched socket reported an error or hangup
+        Wake     = 0x08,    // Someone called ReactorLoop::Wake for this handler
+        Tick     = 0x10     // Periodic housekeeping tick
+    };
+
+    virtual ~IReactorHandler() = default;
+
+    virtual void OnReactorEvent(uint32_t events) = 0;
+};
+
+// ReactorLoop
+//
+// One reactor thread and its epoll set.  Handlers are identified by tokens rather than pointers
+// so that an event that was already returned by epoll_wait for a handler that has since been
+// detached is simply dropped.
+
+class ReactorLoop
+{
+    static constexpr auto kTickInterval = 250ms;
+    static constexpr int  kMaxEvents    = 64;
+    static constexpr uint64_t kWakeToken = 0;
+
+    static inline atomic<uint64_t> _nextToken{1};
+
+    int           _epollFd = -1;
+    WakeEvent     _wake;
+    atomic<bool>  _running{true};
+
+    mutex         _dispatchMutex;    // Held while handlers are being called
+    unordered_map<uint64_t, IReactorHandler *> _handlers;
+    atomic<size_t> _handlerCount{0};
+
+    mutex            _pendingMutex;
+    vector<uint64_t> _pendingWakes;
+
+    thread        _thread;
+
+public:
+    ReactorLoop()
+    {
+        #if defined(__linux__)
+            _epollFd = epoll_create1(EPOLL_CLOEXEC);
+            if (_epollFd == -1)
+                throw runtime_error("Could not create epoll set: " + string(strerror(errno)));
+
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = kWakeToken;
+            epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wake.Fd(), &ev);
+
+            _thread = thread(&ReactorLoop::Run, this);
+        #else
+            throw runtime_error("The socket reactor requires epoll");
+        #endif
+    }
+
+    ~ReactorLoop()
+    {
+        _running = false;
+        _wake.Signal();
+
+        if (_thread.joinable())
+            _thread.join();
+
+        if (_epollFd != -1)
+            close(_epollFd);
+    }
+
+    static uint64_t NextToken()
+    {
+        return _nextToken++;
+    }
+
+    size_t HandlerCount() const
+    {
+        return _handlerCount;
+    }
+
+    void Attach(uint64_t token, IReactorHandler * handler)
+    {
+        lock_guard lock(_dispatchMutex);
+        _handlers[token] = handler;
+        _handlerCount = _handlers.size();
+    }
+
+    // Detach
+    //
+    // Removes the handler.  Because handlers only run while the dispatch mutex is held, once
+    // this returns the handler is guaranteed not to be called again, and only then may its
+    // owner touch the sockets the handler opens and closes, including to Unwatch them.  Must
+    // not be called from within a handler callback.
+
+    void Detach(uint64_t token)
+    {
+        lock_guard lock(_dispatchMutex);
+        _handlers.erase(token);
+        _handlerCount = _handlers.size();
+    }
+
+    // Watch
+    //
+    // Registers or updates the socket associated with a handler.  Readability is always watched;
+    // writability only when the handler has data it couldn't send yet, since a level-triggered
+    // EPOLLOUT on an idle socket would fire continuously.
+
+    void Watch(uint64_t token, int fd, bool wantWrite)
+    {
+        #if defined(__linux__)
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLRDHUP | (wantWrite ? uint32_t(EPOLLOUT) : 0u);
+            ev.data.u64 = token;
+            if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &ev) == -1 && errno == ENOENT)
+                epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev);
+        #endif
+    }
+
+    void Unwatch(int fd)
+    {
+        #if defined(__linux__)
+            epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        #endif
+    }
+
+    // Wake
+    //
+    // Thread-safe; queues a Wake event for the handler and kicks the reactor thread.
+
+    void Wake(uint64_t token)
+    {
+        {
+            lock_guard lock(_pendingMutex);
+            _pendingWakes.push_back(token);
+        }
+        _wake.Signal();
+    }
+
+private:
+
+    void Dispatch(uint64_t token, uint32_t events)
+    {
+        auto it = _handlers.find(token);
+        if (it == _handlers.end())
+            return;
+
+        try
+        {
+            it->second->OnReactorEvent(events);
+        }
+        catch (const exception &e)
+        {
+            logger->warn("Reactor handler exception: {}", e.what());
+        }
+    }
+
+    void Run()
+    {
+        #if defined(__linux__)
+            epoll_event events[kMaxEvents];
+            vector<uint64_t> wakes;
+            auto nextTick = steady_clock::now() + kTickInterval;
+
+            while (_running)
+            {
+                auto timeout = duration_cast<milliseconds>(nextTick - steady_clock::now()).count();
+                int count = epoll_wait(_epollFd, events, kMaxEvents, static_cast<int>(max<int64_t>(0, timeout)));
+                if (count == -1 && errno != EINTR)
+                {
+                    logger->error("epoll_wait failed: {}", strerror(errno));
+                    this_thread::sleep_for(kTickInterval);
+                    continue;
+                }
+
+                lock_guard lock(_dispatchMutex);
+
+                for (int i = 0; i < count; ++i)
+                {
+                    if (events[i].data.u64 == kWakeToken)
+                    {
+                        _wake.Drain();
+                        lock_guard pendingLock(_pendingMutex);
+                        wakes.swap(_pendingWakes);
+                        continue;
+                    }
+
+                    uint32_t mask = 0;
+                    if (events[i].events & EPOLLIN)
+                        mask |= IReactorHandler::Readable;
+                    if (events[i].events & EPOLLOUT)
+                        mask |= IReactorHandler::Writable;
+                    if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+                        mask |= IReactorHandler::Hangup;
+
+                    Dispatch(events[i].data.u64, mask);
+                }
+
+                for (auto token : wakes)
+                    Dispatch(token, IReactorHandler::Wake);
+                wakes.clear();
+
+                auto now = steady_clock::now();
+                if (now >= nextTick)
+                {
+                    nextTick = now + kTickInterval;
+                    for (auto & [token, handler] : _handlers)
+                        Dispatch(token, IReactorHandler::Tick);
+                }
+            }
+        #endif
+    }
+};
+
+// SocketReactor
+//
+// The process-wide pool of reactor loops.  Loops are created lazily the first time a channel
+// asks for one, and channels are assigned to whichever loop currently has the fewest handlers.
+
+class SocketReactor
+{
+    mutable mutex _mutex;
+    size_t        _threadCount = 0;
+    vector<unique_ptr<ReactorLoop>> _loops;
+
+public:
+    static SocketReactor & Instance()
+    {
+        static SocketReactor instance;
+        return instance;
+    }
+
+    static constexpr bool IsSupported()
+    {
+        #if defined(__linux__)
+            return true;
+        #else
+            return false;
+        #endif
+    }
+
+    // SetThreadCount
+    //
+    // Changing the count only affects channels started afterwards; channels that are already
+    // attached to a loop stay there until they are stopped.
+
+    void SetThreadCount(size_t count)
+    {
+        if (count > 0 && !IsSupported())
+            logger->warn("Socket reactor is not supported on this platform, using per-channel threads");
+
+        lock_guard lock(_mutex);
+        _threadCount = count;
+    }
+
+    size_t ThreadCount() const
+    {
+        lock_guard lock(_mutex);
+        return _threadCount;
+    }
+
+    bool IsEnabled() const
+    {
+        return IsSupported() && ThreadCount() > 0;
+    }
+
+    ReactorLoop & AcquireLoop()
+    {
+        lock_guard lock(_mutex);
+        if (_threadCount == 0)
+            throw runtime_error("Socket reactor is not enabled");
+
+        while (_loops.size() < _threadCount)
+            _loops.push_back(make_unique<ReactorLoop>());
+
+        auto best = _loops.begin();
+        for (auto it = _loops.begin(); it != _loops.begin() + _threadCount; ++it)
+            if ((*it)->HandlerCount() < (*best)->HandlerCount())
+                best = it;
+
+        return **best;
+    }
+};
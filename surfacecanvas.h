@@ -0,0 +1,34 @@
+#pragma once
+using namespace std;
+
+// SurfaceCanvas
+//
+// Lets an effect draw somewhere other than its canvas.  It's the real canvas in every respect,
+// features, effects manager and all, except that Graphics() is an off-screen surface, which is
+// how layers and transitions render several effects separately and then combine them.
+
+#include "interfaces.h"
+#include "basegraphics.h"
+
+class SurfaceCanvas : public ICanvas
+{
+    ICanvas      & _canvas;
+    BaseGraphics & _surface;
+
+public:
+    SurfaceCanvas(ICanvas &canvas, BaseGraphics &surface) : _canvas(canvas), _surface(surface) {}
+
+    uint32_t Id() const override                                        { return _canvas.Id(); }
+    uint32_t SetId(uint32_t id) override                                { return _canvas.SetId(id); }
+    string Name() const override                                        { return _canvas.Name(); }
+    uint32_t AddFeature(shared_ptr<ILEDFeature> feature) override       { return _canvas.AddFeature(feature); }
+    bool RemoveFeatureById(uint16_t featureId) override                 { return _canvas.RemoveFeatureById(featureId); }
+    vector<shared_ptr<ILEDFeature>> Features() override                 { return _canvas.Features(); }
+    const vector<shared_ptr<ILEDFeature>> Features() const override     { return static_cast<const ICanvas &>(_canvas).Features(); }
+    ILEDGraphics & Graphics() override                                  { return _surface; }
+    const ILEDGraphics & Graphics() const override                      { return _surface; }
+    const ILEDGraphics & FrontGraphics() const override                 { return _canvas.FrontGraphics(); }
+    void PresentFrame() override                                        { }
+    IEffectsManager & Effects() override                                { return _canvas.Effects(); }
+    const IEffectsManager & Effects() const override                    { return static_cast<const ICanvas &>(_canvas).Effects(); }
+};
@@ -13,11 +13,29 @@
 
 #include "../basegraphics.h"
 #include "../ledfeature.h"
+#include "../featureframes.h"
+#include "../workerpool.h"
+#include "../framescheduler.h"
+#include "../schedule.h"
+#include "../compositor.h"
+#include "../pixelkernels.h"
+#include "../planarsurface.h"
+#include "../transition.h"
+
+// The effect headers that canvas.h pulls in aren't built with -Werror in the main build
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wreorder"
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+#include "../canvas.h"
+#pragma GCC diagnostic pop
 
 using json = nlohmann::json;
 using namespace std;
 using namespace std::chrono;
 
+atomic<uint32_t> Canvas::_nextId{0};
 atomic<uint32_t> LEDFeature::_nextId{0};
 atomic<uint32_t> SocketChannel::_nextId{0};
 shared_ptr<spdlog::logger> logger = spdlog::null_logger_mt("tests");
@@ -51,6 +69,13 @@ public:
     void Stop() override {}
     void SetFPS(uint16_t fps) override { _fps = fps; }
     uint16_t GetFPS() const override { return _fps; }
+    bool IsPipelined() const override { return false; }
+    void SetPipelined(bool) override {}
+    milliseconds GetRenderAhead() const override { return 0ms; }
+    void SetRenderAhead(milliseconds) override {}
+    TransitionType GetTransitionType() const override { return TransitionType::Cut; }
+    milliseconds GetTransitionDuration() const override { return 0ms; }
+    void SetTransition(TransitionType, milliseconds) override {}
     void SetEffects(vector<shared_ptr<ILEDEffect>>) override {}
     void SetCurrentEffectIndex(int) override {}
 
@@ -80,6 +105,8 @@ public:
     const vector<shared_ptr<ILEDFeature>> Features() const override { return _features; }
     ILEDGraphics& Graphics() override { return _graphics; }
     const ILEDGraphics& Graphics() const override { return _graphics; }
+    const ILEDGraphics& FrontGraphics() const override { return _graphics; }
+    void PresentFrame() override {}
     IEffectsManager& Effects() override { return _effects; }
     const IEffectsManager& Effects() const override { return _effects; }
 
@@ -947,3 +974,1130 @@ TEST_F(APITest, CanvasRuntimeControlEndpointsSupportWebUiFlow)
     );
     ASSERT_EQ(deleteCanvasResponse.status_code, 204);
 }
+
+TEST(FrameRingTest, EnforcesSlotAndByteBudgetsAndSharesFrames)
+{
+    FrameRing ring(2, 10);
+    auto shared = make_shared<const vector<uint8_t>>(4, 0x11);
+
+    ASSERT_TRUE(ring.TryPush(shared));
+    ASSERT_FALSE(ring.TryPush(make_shared<const vector<uint8_t>>(7, 0x22)));     // Over the byte budget
+    ASSERT_TRUE(ring.TryPush(make_shared<const vector<uint8_t>>(6, 0x33)));
+    ASSERT_FALSE(ring.TryPush(make_shared<const vector<uint8_t>>(1, 0x44)));     // Out of slots
+    ASSERT_FALSE(ring.TryPush(FramePtr()));
+    ASSERT_EQ(ring.Size(), 2u);
+    ASSERT_EQ(ring.QueuedBytes(), 10u);
+
+    // The ring holds a reference to the frame rather than a copy of it
+    ASSERT_EQ(ring.Peek(), shared.get());
+    ASSERT_EQ(shared.use_count(), 2);
+
+    FramePtr frame;
+    ASSERT_TRUE(ring.TryPop(frame));
+    ASSERT_EQ(frame, shared);
+    ASSERT_EQ(ring.QueuedBytes(), 6u);
+
+    ASSERT_TRUE(ring.TryPop(frame));
+    ASSERT_EQ(*frame, vector<uint8_t>(6, 0x33));
+    ASSERT_EQ(shared.use_count(), 1);
+    ASSERT_TRUE(ring.Empty());
+    ASSERT_EQ(ring.QueuedBytes(), 0u);
+    ASSERT_FALSE(ring.TryPop(frame));
+
+    ASSERT_TRUE(ring.TryPush(shared));
+    ASSERT_EQ(ring.Clear(), 1u);
+    ASSERT_TRUE(ring.Empty());
+    ASSERT_EQ(shared.use_count(), 1);
+}
+
+TEST(SocketChannelTest, DropNewestPolicyDropsOverflowWithoutReset)
+{
+    SocketChannel channel("127.0.0.1", "Backpressure", 49152);
+    channel.SetBackpressurePolicy(BackpressurePolicy::DropNewest);
+
+    for (size_t i = 0; i < channel.GetQueueMaxSize(); i++)
+        ASSERT_TRUE(channel.EnqueueFrame(vector<uint8_t>(16, 0xAB)));
+
+    ASSERT_FALSE(channel.EnqueueFrame(vector<uint8_t>(16, 0xCD)));
+    ASSERT_EQ(channel.GetCurrentQueueDepth(), channel.GetQueueMaxSize());
+    ASSERT_EQ(channel.GetDroppedFrameCount(), 1u);
+    ASSERT_EQ(json(channel)["backpressure"], "dropNewest");
+}
+
+TEST(SocketChannelTest, BatchedSendsArriveAsTheFramesInOrder)
+{
+    // Frames bigger than the socket buffers, so that sendmsg keeps stopping part way through a
+    // frame and the next batch has to pick up from there
+    vector<vector<uint8_t>> frames;
+    vector<uint8_t> expected;
+    for (size_t i = 0; i < 40; i++)
+    {
+        vector<uint8_t> frame(1000 + (i * 7919) % 30000);
+        for (size_t j = 0; j < frame.size(); j++)
+            frame[j] = static_cast<uint8_t>(i * 31 + j * 7 + (j >> 8));
+        expected.insert(expected.end(), frame.begin(), frame.end());
+        frames.push_back(std::move(frame));
+    }
+
+    for (bool reactor : { false, true })
+    {
+        SCOPED_TRACE(reactor ? "reactor" : "worker thread");
+        SocketReactor::Instance().SetThreadCount(reactor ? 1 : 0);
+
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_NE(listener, -1);
+        int receiveBuffer = 4096;
+        setsockopt(listener, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+        ASSERT_EQ(listen(listener, 1), 0);
+        socklen_t addressLength = sizeof(address);
+        ASSERT_EQ(getsockname(listener, reinterpret_cast<sockaddr *>(&address), &addressLength), 0);
+
+        SocketChannel channel("127.0.0.1", "BatchTest", ntohs(address.sin_port));
+        channel.SetSendBufferSize(4096);
+        channel.SetBatchLimits(16, 64 * 1024);
+        channel.Start();
+
+        for (const auto &frame : frames)
+            ASSERT_TRUE(channel.EnqueueFrame(vector<uint8_t>(frame)));
+
+        int client = accept(listener, nullptr, nullptr);
+        ASSERT_NE(client, -1);
+        timeval timeout{5, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        // Reading in small pieces keeps the sender's buffer full for most of the stream
+        vector<uint8_t> received;
+        uint8_t buffer[1500];
+        while (received.size() < expected.size())
+        {
+            ssize_t count = recv(client, buffer, sizeof(buffer), 0);
+            if (count <= 0)
+                break;
+            received.insert(received.end(), buffer, buffer + count);
+        }
+
+        EXPECT_EQ(received.size(), expected.size());
+        EXPECT_TRUE(received == expected);
+
+        // The last frame is counted just after sendmsg returns, which can be after it arrived
+        for (int i = 0; i < 100 && channel.GetSentFrameCount() < frames.size(); i++)
+            this_thread::sleep_for(10ms);
+        EXPECT_EQ(channel.GetSentFrameCount(), frames.size());
+        EXPECT_EQ(channel.GetDroppedFrameCount(), 0u);
+
+        channel.Stop();
+        close(client);
+        close(listener);
+    }
+
+    SocketReactor::Instance().SetThreadCount(0);
+}
+
+TEST(SocketChannelTest, ReactorChannelDeliversPromptlyAfterRestart)
+{
+    SocketReactor::Instance().SetThreadCount(1);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(listener, -1);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    ASSERT_EQ(listen(listener, 2), 0);
+    socklen_t addressLength = sizeof(address);
+    ASSERT_EQ(getsockname(listener, reinterpret_cast<sockaddr *>(&address), &addressLength), 0);
+    timeval timeout{2, 0};
+    setsockopt(listener, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    SocketChannel channel("127.0.0.1", "RestartTest", ntohs(address.sin_port));
+
+    auto receiveFrame = [](int client, size_t size)
+    {
+        vector<uint8_t> frame;
+        uint8_t buffer[256];
+        while (frame.size() < size)
+        {
+            ssize_t count = recv(client, buffer, min(sizeof(buffer), size - frame.size()), 0);
+            if (count <= 0)
+                break;
+            frame.insert(frame.end(), buffer, buffer + count);
+        }
+        return frame;
+    };
+
+    auto acceptClient = [&]()
+    {
+        int client = accept(listener, nullptr, nullptr);
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        return client;
+    };
+
+    channel.Start();
+    ASSERT_TRUE(channel.EnqueueFrame(vector<uint8_t>(64, 1)));
+    int client = acceptClient();
+    ASSERT_NE(client, -1);
+    ASSERT_EQ(receiveFrame(client, 64), vector<uint8_t>(64, 1));
+    channel.Stop();
+    close(client);
+
+    // Reconnecting too soon would only drop the frame, so wait out the reconnect delay.  A
+    // frame queued while stopped leaves a wake behind that no handler will ever run.
+    this_thread::sleep_for(ReconnectBackoff::kBaseDelay + 100ms);
+    ASSERT_TRUE(channel.EnqueueFrame(vector<uint8_t>(64, 2)));
+    channel.Start();
+    client = acceptClient();
+    ASSERT_NE(client, -1);
+    ASSERT_EQ(receiveFrame(client, 64), vector<uint8_t>(64, 2));
+
+    // Each of these would otherwise wait for the reactor's 250ms tick
+    auto start = steady_clock::now();
+    for (uint8_t i = 3; i < 8; i++)
+    {
+        ASSERT_TRUE(channel.EnqueueFrame(vector<uint8_t>(64, i)));
+        ASSERT_EQ(receiveFrame(client, 64), vector<uint8_t>(64, i));
+    }
+    EXPECT_LT(steady_clock::now() - start, 500ms);
+
+    channel.Stop();
+    close(client);
+    close(listener);
+    SocketReactor::Instance().SetThreadCount(0);
+}
+
+TEST(FlowControllerTest, ThrottlesWhenClientBufferRunsFullAndRecovers)
+{
+    FlowController flow;
+    flow.Configure(true, 0.5);
+
+    auto now = steady_clock::now();
+    for (int i = 0; i < 10; i++)
+    {
+        now += FlowController::kUpdateInterval;
+        flow.OnClientResponse(90, 100, 0, now);
+    }
+    ASSERT_LT(flow.SendRatio(), 0.5);
+    ASSERT_GE(flow.SendRatio(), FlowController::kMinSendRatio);
+
+    int admitted = 0;
+    for (int i = 0; i < 100; i++)
+        admitted += flow.Admit() ? 1 : 0;
+    ASSERT_NEAR(admitted, flow.SendRatio() * 100, 2);
+
+    for (int i = 0; i < 40; i++)
+    {
+        now += FlowController::kUpdateInterval;
+        flow.OnClientResponse(10, 100, 0, now);
+    }
+    ASSERT_DOUBLE_EQ(flow.SendRatio(), 1.0);
+}
+
+TEST(UdpSocketChannelTest, FragmentsFramesAndCountsLostFrames)
+{
+    int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_NE(receiver, -1);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(receiver, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    socklen_t addressLength = sizeof(address);
+    ASSERT_EQ(getsockname(receiver, reinterpret_cast<sockaddr *>(&address), &addressLength), 0);
+
+    timeval timeout{2, 0};
+    setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    UdpSocketChannel channel("127.0.0.1", "UdpTest", ntohs(address.sin_port));
+    channel.Start();
+
+    vector<uint8_t> frame(UdpSocketChannel::MaxFragmentPayload * 2 + 100);
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = static_cast<uint8_t>(i * 7);
+    ASSERT_TRUE(channel.EnqueueFrame(vector<uint8_t>(frame)));
+
+    // Reassemble the frame from its fragments
+    vector<uint8_t> reassembled(frame.size());
+    sockaddr_in sender{};
+    socklen_t senderLength = sizeof(sender);
+    for (int i = 0; i < 3; i++)
+    {
+        uint8_t datagram[UdpSocketChannel::MaxDatagramSize];
+        ssize_t received = recvfrom(receiver, datagram, sizeof(datagram), 0, reinterpret_cast<sockaddr *>(&sender), &senderLength);
+        ASSERT_GT(received, static_cast<ssize_t>(UdpSocketChannel::FragmentHeaderSize));
+
+        uint32_t tag, sequence, frameLength;
+        uint16_t index, count;
+        memcpy(&tag, datagram, 4);
+        memcpy(&sequence, datagram + 4, 4);
+        memcpy(&index, datagram + 8, 2);
+        memcpy(&count, datagram + 10, 2);
+        memcpy(&frameLength, datagram + 12, 4);
+        ASSERT_EQ(tag, UdpSocketChannel::FragmentTag);
+        ASSERT_EQ(sequence, 1u);                                                // 0 means no sequence in an ack
+        ASSERT_EQ(count, 3);
+        ASSERT_EQ(frameLength, frame.size());
+
+        memcpy(reassembled.data() + index * UdpSocketChannel::MaxFragmentPayload,
+               datagram + UdpSocketChannel::FragmentHeaderSize,
+               received - UdpSocketChannel::FragmentHeaderSize);
+    }
+    ASSERT_EQ(reassembled, frame);
+
+    auto acknowledge = [&](const sockaddr_in &to, initializer_list<uint64_t> sequences)
+    {
+        for (uint64_t sequence : sequences)
+        {
+            ClientResponse response;
+            response.sequence = sequence;
+            sendto(receiver, &response, sizeof(response), 0, reinterpret_cast<const sockaddr *>(&to), sizeof(to));
+        }
+    };
+
+    // Acknowledge the first frame and then 4, which means 2 and 3 went missing
+    acknowledge(sender, { 1, 4 });
+
+    for (int i = 0; i < 100 && channel.GetLostFrameCount() < 2; i++)
+        this_thread::sleep_for(10ms);
+
+    ASSERT_EQ(channel.GetLostFrameCount(), 2u);
+    ASSERT_EQ(channel.GetSentFrameCount(), 1u);
+    ASSERT_EQ(json(static_cast<const ISocketChannel &>(channel))["transport"], "udp");
+    channel.Stop();
+
+    // Counting carries on across the wrap, where 0 is skipped rather than lost, so only 1 is
+    // missing; a late ack for an older frame changes nothing
+    UdpSocketChannel wrapping("127.0.0.1", "UdpWrapTest", ntohs(address.sin_port));
+    wrapping.Start();
+    ASSERT_TRUE(wrapping.EnqueueFrame(vector<uint8_t>(16)));
+    uint8_t datagram[UdpSocketChannel::MaxDatagramSize];
+    ASSERT_GT(recvfrom(receiver, datagram, sizeof(datagram), 0, reinterpret_cast<sockaddr *>(&sender), &senderLength), 0);
+
+    acknowledge(sender, { 0xFFFFFFFE, 0xFFFFFFFF, 2, 0xFFFFFFFD });
+    for (int i = 0; i < 100 && wrapping.GetLostFrameCount() < 1; i++)
+        this_thread::sleep_for(10ms);
+    this_thread::sleep_for(50ms);
+
+    ASSERT_EQ(wrapping.GetLostFrameCount(), 1u);
+
+    wrapping.Stop();
+    close(receiver);
+}
+
+TEST(FeatureFramesTest, UdpFeaturesOnOneDestinationOnlyShareIdenticalFrames)
+{
+    int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_NE(receiver, -1);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(receiver, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    socklen_t addressLength = sizeof(address);
+    ASSERT_EQ(getsockname(receiver, reinterpret_cast<sockaddr *>(&address), &addressLength), 0);
+
+    timeval timeout{0, 300000};
+    setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Two channels of one controller, plus a copy of the first that adds nothing new
+    FeatureMappingCanvas canvas(8, 2);
+    auto udpFeature = [&](const string &name, uint8_t channel, uint32_t offsetY)
+    {
+        auto feature = make_shared<LEDFeature>("127.0.0.1", name, ntohs(address.sin_port), 8, 1, 0, offsetY,
+                                               false, channel, false, 24, SocketTransport::Udp);
+        feature->Socket()->SetCodec(FrameCodec::Raw, 0);
+        feature->Socket()->Start();
+        canvas.AddFeature(feature);
+        return feature;
+    };
+    auto first = udpFeature("First", 0, 0);
+    auto second = udpFeature("Second", 1, 1);
+    auto copy = udpFeature("Copy", 0, 0);
+
+    auto groups = FeatureFrames::GroupFeatures(canvas.Features());
+    ASSERT_EQ(groups.size(), 2u);
+    EXPECT_EQ(groups[0], FeatureFrames::Group{ first });
+    EXPECT_EQ(groups[1], FeatureFrames::Group{ second });
+
+    FeatureFrames::Send(canvas, system_clock::now());
+
+    // Raw frames arrive as is after the fragment header, with the channel right after the
+    // frame type
+    vector<uint16_t> channels;
+    uint8_t datagram[UdpSocketChannel::MaxDatagramSize];
+    ssize_t received;
+    while ((received = recv(receiver, datagram, sizeof(datagram), 0)) > 0)
+    {
+        ASSERT_GE(received, static_cast<ssize_t>(UdpSocketChannel::FragmentHeaderSize + LEDFeature::kDataFrameHeaderSize));
+        uint16_t channel;
+        memcpy(&channel, datagram + UdpSocketChannel::FragmentHeaderSize + 2, sizeof(channel));
+        channels.push_back(channel);
+    }
+    sort(channels.begin(), channels.end());
+    EXPECT_EQ(channels, (vector<uint16_t>{ 0, 1 }));
+
+    for (const auto &feature : canvas.Features())
+        feature->Socket()->Stop();
+    close(receiver);
+}
+
+TEST(FramePoolTest, CompressedFramesAreBuiltInPlaceAndRecycled)
+{
+    FeatureMappingCanvas canvas(8, 1);
+    auto feature = make_shared<LEDFeature>("127.0.0.1", "Pool Feature", 49152, 8);
+    canvas.AddFeature(feature);
+    for (uint32_t x = 0; x < 8; x++)
+        canvas.Graphics().SetPixel(x, 0, CRGB(x, 2 * x, 3 * x));
+
+    auto timestamp = system_clock::now();
+    auto data = FramePool::Instance().Acquire(feature->DataFrameSize());
+    feature->WriteDataFrame(timestamp, data->data());
+    ASSERT_EQ(*data, feature->GetDataFrame(timestamp));
+
+    auto frame = feature->Socket()->CompressFrame(data->data(), data->size());
+    ASSERT_EQ(frame->size(), FrameEncoder::HeaderSize + (*frame)[4] + ((*frame)[5] << 8));
+
+    vector<uint8_t> expanded(data->size());
+    uLongf expandedSize = expanded.size();
+    ASSERT_EQ(uncompress(expanded.data(), &expandedSize, frame->data() + FrameEncoder::HeaderSize,
+                         frame->size() - FrameEncoder::HeaderSize), Z_OK);
+    ASSERT_EQ(expanded, *data);
+
+    // Both buffers go back to the pool once the last reference is gone
+    auto available = FramePool::Instance().Available();
+    data.reset();
+    frame.reset();
+    ASSERT_EQ(FramePool::Instance().Available(), available + 2);
+}
+
+TEST(FrameCompressorTest, ReusesOneStreamAcrossFramesOfDifferentSizes)
+{
+    FrameCompressor compressor;
+
+    for (size_t size : { 96u, 96u, 49152u, 432u, 49152u })
+    {
+        vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; i++)
+            data[i] = static_cast<uint8_t>(i * 7 + size);
+
+        auto frame = compressor.Compress(data.data(), data.size(), 4);
+
+        vector<uint8_t> expanded(size);
+        uLongf expandedSize = expanded.size();
+        ASSERT_EQ(uncompress(expanded.data(), &expandedSize, frame->data() + 4, frame->size() - 4), Z_OK);
+        ASSERT_EQ(expandedSize, size);
+        ASSERT_EQ(expanded, data);
+    }
+}
+
+TEST(FrameEncoderTest, DeltaFramesApplyToThePreviousFrameUntilAKeyframeIsForced)
+{
+    auto readDword = [](const FramePtr & frame, size_t offset)
+    {
+        return uint32_t((*frame)[offset]) | uint32_t((*frame)[offset + 1]) << 8 |
+               uint32_t((*frame)[offset + 2]) << 16 | uint32_t((*frame)[offset + 3]) << 24;
+    };
+
+    auto expand = [&](const FramePtr & frame)
+    {
+        vector<uint8_t> expanded(readDword(frame, 8));
+        uLongf expandedSize = expanded.size();
+        EXPECT_EQ(uncompress(expanded.data(), &expandedSize, frame->data() + FrameEncoder::HeaderSize,
+                             frame->size() - FrameEncoder::HeaderSize), Z_OK);
+        return expanded;
+    };
+
+    vector<uint8_t> first(3 * 512), second(3 * 512);
+    for (size_t i = 0; i < first.size(); i++)
+    {
+        first[i] = static_cast<uint8_t>(i / 3);
+        second[i] = static_cast<uint8_t>(i / 3 + (i % 97 == 0));
+    }
+
+    FrameEncoder encoder;
+    encoder.Configure(FrameCodec::Delta, Z_BEST_SPEED);
+
+    auto keyframe = encoder.Encode(first.data(), first.size());
+    ASSERT_EQ(readDword(keyframe, 0), FrameEncoder::CompressedTag);
+    ASSERT_EQ(expand(keyframe), first);
+
+    auto delta = encoder.Encode(second.data(), second.size());
+    ASSERT_EQ(readDword(delta, 0), FrameEncoder::DeltaTag);
+    ASSERT_EQ(readDword(delta, 12), adler32(adler32(0, Z_NULL, 0), first.data(), first.size()));
+
+    auto applied = expand(delta);
+    for (size_t i = 0; i < applied.size(); i++)
+        applied[i] ^= first[i];
+    ASSERT_EQ(applied, second);
+
+    // A new epoch means a frame may have been lost, so the next frame has to stand on its own
+    auto forced = encoder.Encode(first.data(), first.size(), 1);
+    ASSERT_EQ(readDword(forced, 0), FrameEncoder::CompressedTag);
+
+    // Raw frames are passed through untouched
+    encoder.Configure(FrameCodec::Raw, Z_BEST_SPEED);
+    ASSERT_EQ(*encoder.Encode(first.data(), first.size()), first);
+    ASSERT_EQ(encoder.ActiveCodec(), FrameCodec::Raw);
+}
+
+TEST(FrameEncoderTest, ReusesCompressedPixelsAndSkipsUnchangedFrames)
+{
+    constexpr size_t headerSize = 24;
+
+    vector<uint8_t> frame(headerSize + 3 * 300);
+    for (size_t i = headerSize; i < frame.size(); i++)
+        frame[i] = static_cast<uint8_t>(i * 13 / 7);
+    auto pixelHash = Utilities::HashBytes(frame.data() + headerSize, frame.size() - headerSize);
+
+    FrameEncoder encoder;
+    for (uint8_t timestamp = 0; timestamp < 4; timestamp++)
+    {
+        // Only the header changes from frame to frame, and every encoding has to decode to it
+        frame[16] = timestamp;
+        auto encoded = encoder.Encode(frame.data(), frame.size(), 0, headerSize, pixelHash);
+
+        vector<uint8_t> expanded(frame.size());
+        uLongf expandedSize = expanded.size();
+        ASSERT_EQ(uncompress(expanded.data(), &expandedSize, encoded->data() + FrameEncoder::HeaderSize,
+                             encoded->size() - FrameEncoder::HeaderSize), Z_OK);
+        ASSERT_EQ(expanded, frame);
+    }
+
+    auto now = steady_clock::now();
+    ASSERT_TRUE(encoder.ShouldEncode(pixelHash, 0, now));
+
+    encoder.SetSkipUnchanged(true, 500ms);
+    ASSERT_FALSE(encoder.ShouldEncode(pixelHash, 0, now + 100ms));
+    ASSERT_TRUE(encoder.ShouldEncode(pixelHash + 1, 0, now + 200ms));            // Pixels changed
+    ASSERT_TRUE(encoder.ShouldEncode(pixelHash + 1, 1, now + 300ms));            // Last frame may be lost
+    ASSERT_FALSE(encoder.ShouldEncode(pixelHash + 1, 1, now + 400ms));
+    ASSERT_TRUE(encoder.ShouldEncode(pixelHash + 1, 1, now + 800ms));            // Keepalive
+    ASSERT_EQ(encoder.SkippedFrames(), 2u);
+}
+
+TEST(WorkerPoolTest, ParallelForRunsEveryIndexOnceAndRethrows)
+{
+    auto &pool = WorkerPool::Instance();
+    pool.SetThreadCount(3);
+
+    vector<atomic<int>> calls(100);
+    pool.ParallelFor(calls.size(), [&](size_t i) { calls[i]++; });
+    for (const auto &count : calls)
+        ASSERT_EQ(count.load(), 1);
+
+    atomic<int> ran = 0;
+    ASSERT_THROW(pool.ParallelFor(10, [&](size_t i)
+    {
+        ran++;
+        if (i == 5)
+            throw runtime_error("feature failed");
+    }), runtime_error);
+    ASSERT_EQ(ran.load(), 10);                                                  // The rest still ran
+
+    auto caller = this_thread::get_id();
+    thread::id poster;
+    pool.Post([&] { poster = this_thread::get_id(); }).get();
+    ASSERT_NE(poster, caller);                                                  // Pipelined frames encode elsewhere
+
+    pool.SetThreadCount(0);
+    ASSERT_EQ(pool.ThreadCount(), 0u);
+    size_t serial = 0;
+    pool.ParallelFor(4, [&](size_t) { serial++; });
+    ASSERT_EQ(serial, 4u);
+
+    auto posted = pool.Post([&] { poster = this_thread::get_id(); });
+    ASSERT_EQ(poster, caller);
+    posted.get();
+}
+
+TEST(CompositorTest, BlendsByModeAndWeight)
+{
+    const CRGB below(200, 100, 0), layer(100, 200, 255);
+    auto blended = [&](BlendMode mode, double opacity)
+    {
+        CRGB pixel = below;
+        Compositor::Blend(mode, &pixel, &layer, 1, Compositor::OpacityWeight(opacity));
+        return pixel;
+    };
+
+    EXPECT_EQ(blended(BlendMode::Alpha, 1.0), layer);
+    EXPECT_EQ(blended(BlendMode::Alpha, 0.0), below);
+    EXPECT_EQ(blended(BlendMode::Alpha, 0.5), CRGB(150, 150, 127));
+    EXPECT_EQ(blended(BlendMode::Add, 1.0), CRGB(255, 255, 255));
+    EXPECT_EQ(blended(BlendMode::Add, 0.5), CRGB(250, 200, 127));
+    EXPECT_EQ(blended(BlendMode::Max, 1.0), CRGB(200, 200, 255));
+    EXPECT_EQ(blended(BlendMode::Multiply, 1.0), CRGB(78, 78, 0));
+    EXPECT_EQ(blended(BlendMode::Multiply, 0.0), below);
+
+    // Long enough for the vectorized loop and its tail, with white multiplying to no change
+    vector<CRGB> pixels(37, below), white(37, CRGB(255, 255, 255));
+    Compositor::Blend(BlendMode::Multiply, pixels.data(), white.data(), pixels.size(), Compositor::kOpaque);
+    for (const auto &pixel : pixels)
+        ASSERT_EQ(pixel, below);
+
+    EXPECT_TRUE(Compositor::Covers(BlendMode::Alpha, Compositor::OpacityWeight(1.0)));
+    EXPECT_FALSE(Compositor::Covers(BlendMode::Alpha, Compositor::OpacityWeight(0.99)));
+    EXPECT_FALSE(Compositor::Covers(BlendMode::Max, Compositor::kOpaque));
+    EXPECT_EQ(nlohmann::json(BlendMode::Multiply), "multiply");
+}
+
+TEST(BaseGraphicsTest, RowsAndWritePixelsStayInsideTheBuffer)
+{
+    BaseGraphics graphics(4, 3);
+    auto row = graphics.Row(1);
+    ASSERT_EQ(row.size(), 4u);
+    row[3] = CRGB::Red;
+    EXPECT_EQ(graphics.GetPixel(3, 1), CRGB(CRGB::Red));
+    EXPECT_EQ(&graphics.Pixels()[7], &row[3]);
+    EXPECT_THROW(graphics.Row(3), out_of_range);
+
+    const vector<CRGB> run(6, CRGB::Blue);
+    graphics.WritePixels(2, 2, run);                                            // Clipped at the end of the row
+    EXPECT_EQ(graphics.GetPixel(1, 2), CRGB(CRGB::Black));
+    EXPECT_EQ(graphics.GetPixel(3, 2), CRGB(CRGB::Blue));
+    graphics.WritePixels(4, 0, run);                                            // Off the edge, ignored
+    graphics.WritePixels(0, 3, run);
+    EXPECT_EQ(graphics.GetPixel(0, 0), CRGB(CRGB::Black));
+}
+
+TEST(PlanarSurfaceTest, KeepsFractionsAndDithersThemOnQuantizing)
+{
+    PlanarSurface surface(256, 1);
+    surface.SetPixelsF(1.5f, 2.0f, CRGB(255, 255, 255));
+    EXPECT_FLOAT_EQ(surface.GetPixel(1, 0)[0], 127.5f);                         // Half covered
+    EXPECT_FLOAT_EQ(surface.GetPixel(2, 0)[0], 255.0f);
+    EXPECT_FLOAT_EQ(surface.GetPixel(3, 0)[0], 127.5f);
+
+    // A dim pixel survives fades that would take 8 bits straight to black
+    surface.SetPixelsF(10, 1, CRGB(0, 2, 0));
+    surface.FadeFrameBy(64);
+    surface.FadeFrameBy(64);
+    EXPECT_GT(surface.GetPixel(10, 0)[1], 1.0f);
+    BaseGraphics bytes(256, 1);
+    bytes.SetPixel(10, 0, CRGB(0, 2, 0));
+    bytes.FadeFrameBy(64);
+    bytes.FadeFrameBy(64);
+    EXPECT_EQ(bytes.GetPixel(10, 0).g, 0);
+
+    // Whole values come out exact, and half way between two comes out as each half the time
+    PlanarSurface half(256, 1), white(256, 1);
+    white.SetPixelsF(0, 256, CRGB(200, 100, 0));
+    half.BlendFrame(white, 0);
+    half.SetPixelsF(0, 256, CRGB(1, 1, 1));
+    half.FadeFrameBy(127);                                                      // 1 * 128 / 256
+    half.Quantize(bytes);
+    EXPECT_EQ(count(bytes.GetPixels().begin(), bytes.GetPixels().end(), CRGB(1, 1, 1)), 128);
+    EXPECT_EQ(count(bytes.GetPixels().begin(), bytes.GetPixels().end(), CRGB(0, 0, 0)), 128);
+
+    half.BlendFrame(white, 256);
+    half.Quantize(bytes);
+    EXPECT_EQ(bytes.GetPixel(77, 0), CRGB(200, 100, 0));
+    BaseGraphics smaller(255, 1);
+    EXPECT_THROW(half.Quantize(smaller), invalid_argument);
+}
+
+TEST(ColorTransformTest, FeaturesSendCorrectedBytesOnEveryPath)
+{
+    EXPECT_TRUE(ColorTransform().IsIdentity());
+    EXPECT_THROW(ColorTransform(0.0, CRGB(UncorrectedColor), CRGB(UncorrectedTemperature), 255), invalid_argument);
+
+    ColorTransform transform(2.2, CRGB(TypicalLEDStrip), CRGB(UncorrectedTemperature), 128);
+    EXPECT_FALSE(transform.IsIdentity());
+    EXPECT_EQ(transform.Table(0)[0], 0);
+    EXPECT_EQ(transform.Table(0)[255], 128);                                   // Brightness only
+    EXPECT_EQ(transform.Table(1)[255], lround(176 * 128 / 255.0));              // Correction and brightness
+    EXPECT_LT(transform.Table(0)[128], 64);                                     // Gamma darkens the middle
+
+    // The whole-canvas strip takes the fused fast path, the offset one the general loop
+    FeatureMappingCanvas canvas(4, 1);
+    for (uint8_t x = 0; x < 4; x++)
+        canvas.Graphics().SetPixel(x, 0, CRGB(x * 60, 255 - x * 60, x * 20 + 100));
+
+    auto whole = make_shared<LEDFeature>("127.0.0.1", "Whole", 49152, 4, 1, 0, 0, true, 0, true, 24, SocketTransport::Tcp, transform);
+    auto part = make_shared<LEDFeature>("127.0.0.1", "Part", 49152, 3, 1, 1, 0, true, 0, true, 24, SocketTransport::Tcp, transform);
+    canvas.AddFeature(whole);
+    canvas.AddFeature(part);
+
+    auto expected = [&](uint32_t first, uint32_t count)
+    {
+        vector<uint8_t> bytes;
+        for (uint32_t x = first + count; x-- > first; )
+        {
+            CRGB pixel = transform.Apply(canvas.Graphics().GetPixel(x, 0));
+            bytes.insert(bytes.end(), { pixel.g, pixel.r, pixel.b });
+        }
+        return bytes;
+    };
+    EXPECT_EQ(whole->GetPixelData(), expected(0, 4));
+    EXPECT_EQ(part->GetPixelData(), expected(1, 3));
+
+    // Presets can be named in the config, and the settings survive a round trip
+    json config = {
+        {"hostName", "127.0.0.1"}, {"friendlyName", "Configured"}, {"width", 4}, {"height", 1},
+        {"gamma", 2.2}, {"colorCorrection", "TypicalLEDStrip"}, {"brightness", 128}
+    };
+    auto configured = config.get<shared_ptr<ILEDFeature>>();
+    EXPECT_EQ(configured->OutputTransform(), transform);
+    auto reloaded = json(*configured).get<shared_ptr<ILEDFeature>>();
+    EXPECT_EQ(reloaded->OutputTransform(), transform);
+    EXPECT_EQ(reloaded->OutputTransform().Correction(), CRGB(TypicalLEDStrip));
+}
+
+TEST(PixelKernelsTest, EveryLevelMatchesTheScalarKernels)
+{
+    const auto &scalar = PixelKernels::For(KernelLevel::Scalar);
+    mt19937 random(7);
+
+    for (auto level : { KernelLevel::SSE2, KernelLevel::AVX2 })
+    {
+        const auto &kernels = PixelKernels::For(level);
+
+        // Lengths around every vector width, so the loops and their tails are all exercised
+        for (size_t pixels : { 1, 5, 6, 11, 16, 17, 32, 33, 97 })
+        {
+            size_t bytes = pixels * sizeof(CRGB);
+            vector<uint8_t> a(bytes), b(bytes);
+            for (size_t i = 0; i < bytes; i++)
+            {
+                a[i] = static_cast<uint8_t>(random());
+                b[i] = static_cast<uint8_t>(random());
+            }
+
+            auto expected = a, actual = a;
+            scalar.scale(expected.data(), bytes, 200);
+            kernels.scale(actual.data(), bytes, 200);
+            ASSERT_EQ(actual, expected) << kernels.name << " scale, " << pixels << " pixels";
+
+            expected = a, actual = a;
+            scalar.addSaturate(expected.data(), b.data(), bytes);
+            kernels.addSaturate(actual.data(), b.data(), bytes);
+            ASSERT_EQ(actual, expected) << kernels.name << " addSaturate, " << pixels << " pixels";
+
+            for (uint16_t weight : { 0, 1, 128, 255, 256 })
+            {
+                expected = a, actual = a;
+                scalar.blend(expected.data(), b.data(), bytes, weight);
+                kernels.blend(actual.data(), b.data(), bytes, weight);
+                ASSERT_EQ(actual, expected) << kernels.name << " blend by " << weight << ", " << pixels << " pixels";
+            }
+
+            scalar.swapRedGreen(expected.data(), a.data(), pixels);
+            kernels.swapRedGreen(actual.data(), a.data(), pixels);
+            ASSERT_EQ(actual, expected) << kernels.name << " swapRedGreen, " << pixels << " pixels";
+            ASSERT_EQ(expected[0], a[1]);
+
+            vector<CRGB> filled(pixels), expectedFill(pixels, CRGB(1, 2, 3));
+            kernels.fill(filled.data(), pixels, CRGB(1, 2, 3));
+            ASSERT_EQ(filled, expectedFill) << kernels.name << " fill, " << pixels << " pixels";
+        }
+    }
+
+    BaseGraphics graphics(7, 3), other(7, 3);
+    graphics.Clear(CRGB(100, 200, 0));
+    other.Clear(CRGB(100, 100, 255));
+    graphics.FadeFrameBy(55);
+    EXPECT_EQ(graphics.GetPixel(6, 2), CRGB(78, 156, 0));
+    graphics.AddFrame(other);
+    EXPECT_EQ(graphics.GetPixel(0, 0), CRGB(178, 255, 255));
+    graphics.BlendFrame(other, 256);
+    EXPECT_EQ(graphics.GetPixel(3, 1), CRGB(100, 100, 255));
+    EXPECT_THROW(graphics.AddFrame(BaseGraphics(3, 7)), invalid_argument);
+}
+
+TEST(TransitionTest, MixesFromTheOutgoingEffectAndFreezesItOverBudget)
+{
+    class FillEffect : public ILEDEffect
+    {
+        string _name = "Fill";
+        CRGB _color;
+    public:
+        int updates = 0;
+        FillEffect(const CRGB &color) : _color(color) {}
+        const string& Name() const override { return _name; }
+        string Type() const override { return "FillEffect"; }
+        void Start(ICanvas &) override {}
+        void Update(ICanvas &canvas, microseconds) override { canvas.Graphics().Clear(_color); updates++; }
+        void SetSchedule(const shared_ptr<ISchedule>) override {}
+        const shared_ptr<ISchedule> GetSchedule() const override { return nullptr; }
+        bool IsDeterministic() const override { return true; }
+    };
+
+    auto red = make_shared<FillEffect>(CRGB::Red);
+    FillEffect blue(CRGB::Blue);
+    FeatureMappingCanvas canvas(64, 4);
+    canvas.Graphics().Clear(CRGB::Red);
+
+    Transition crossfade(TransitionType::Crossfade, 100ms, red, canvas.Graphics());
+    crossfade.Render(canvas, blue, 50ms, 1s);
+    EXPECT_EQ(canvas.Graphics().GetPixel(10, 2), CRGB(127, 0, 127));
+    EXPECT_FALSE(crossfade.IsDone());
+    crossfade.Render(canvas, blue, 50ms, 1s);
+    EXPECT_TRUE(crossfade.IsDone());
+    EXPECT_EQ(canvas.Graphics().GetPixel(10, 2), CRGB(CRGB::Blue));
+
+    canvas.Graphics().Clear(CRGB::Red);
+    Transition wipe(TransitionType::Wipe, 100ms, red, canvas.Graphics());
+    wipe.Render(canvas, blue, 25ms, 1s);
+    EXPECT_EQ(canvas.Graphics().GetPixel(15, 3), CRGB(CRGB::Blue));
+    EXPECT_EQ(canvas.Graphics().GetPixel(16, 0), CRGB(CRGB::Red));
+
+    canvas.Graphics().Clear(CRGB::Red);
+    Transition dissolve(TransitionType::Dissolve, 100ms, red, canvas.Graphics());
+    dissolve.Render(canvas, blue, 50ms, 1s);
+    auto &pixels = canvas.Graphics().GetPixels();
+    auto switched = count(pixels.begin(), pixels.end(), CRGB(CRGB::Blue));
+    EXPECT_GT(switched, 96);
+    EXPECT_LT(switched, 160);
+    EXPECT_EQ(count(pixels.begin(), pixels.end(), CRGB(CRGB::Red)), 256 - switched);
+
+    // Nothing fits in a zero budget, so the outgoing effect only draws the first frame
+    red->updates = 0;
+    Transition overBudget(TransitionType::Crossfade, 100ms, red, canvas.Graphics());
+    for (int i = 0; i < 4; i++)
+        overBudget.Render(canvas, blue, 10ms, 0ns);
+    EXPECT_EQ(red->updates, 1);
+    EXPECT_TRUE(overBudget.IsDeterministic());
+}
+
+// EffectsManagerTest
+//
+// Reaches into an EffectsManager to step its render loop a frame at a time and look at the
+// effect list snapshots it publishes
+
+class EffectsManagerTest : public ::testing::Test
+{
+protected:
+    class StepEffect : public ILEDEffect
+    {
+        string _name;
+        CRGB _color;
+        bool _deterministic;
+    public:
+        vector<microseconds> deltas;
+        StepEffect(const string &name, const CRGB &color = CRGB::Red, bool deterministic = true)
+            : _name(name), _color(color), _deterministic(deterministic) {}
+        const string& Name() const override { return _name; }
+        string Type() const override { return "StepEffect"; }
+        void Start(ICanvas &) override {}
+        void Update(ICanvas &canvas, microseconds delta) override { canvas.Graphics().Clear(_color); deltas.push_back(delta); }
+        void SetSchedule(const shared_ptr<ISchedule>) override {}
+        const shared_ptr<ISchedule> GetSchedule() const override { return nullptr; }
+        bool IsDeterministic() const override { return _deterministic; }
+    };
+
+    static auto Snapshot(const EffectsManager &effects)
+    {
+        return effects.Snapshot();
+    }
+
+    static void StartFrameClock(EffectsManager &effects, ICanvas &canvas)
+    {
+        effects.StartFrameClock(canvas);
+    }
+
+    static steady_clock::time_point RenderFrame(EffectsManager &effects, ICanvas &canvas)
+    {
+        return effects.RenderFrame(canvas);
+    }
+
+    static steady_clock::duration RenderAheadLead(const EffectsManager &effects, ICanvas &canvas, const ILEDEffect &effect)
+    {
+        return effects.RenderAheadLead(canvas, effect);
+    }
+
+    static steady_clock::duration FrameDuration(const EffectsManager &effects)
+    {
+        return effects._clock.frameDuration;
+    }
+
+    // When the frame rendered last is due to be shown
+    static steady_clock::time_point LastFrameTarget(const EffectsManager &effects)
+    {
+        return effects._clock.lastFrameTarget;
+    }
+};
+
+TEST_F(EffectsManagerTest, EditsPublishANewSnapshotAndLeaveOlderOnesAlone)
+{
+    EffectsManager effects(30);
+    auto first = make_shared<StepEffect>("First");
+    shared_ptr<ILEDEffect> second = make_shared<StepEffect>("Second");
+    auto third = make_shared<StepEffect>("Third");
+    effects.AddEffect(first);
+    auto afterAdd = Snapshot(effects);
+    effects.AddEffect(second);
+    effects.AddEffect(third);
+    EXPECT_EQ(afterAdd->size(), 1u);
+    EXPECT_EQ(effects.GetCurrentEffect(), 0u);
+
+    // Removing an effect before the current one keeps the same effect current
+    effects.SetCurrentEffectIndex(2);
+    auto beforeRemove = Snapshot(effects);
+    effects.RemoveEffect(second);
+    auto afterRemove = Snapshot(effects);
+    EXPECT_NE(beforeRemove, afterRemove);
+    ASSERT_EQ(beforeRemove->size(), 3u);
+    EXPECT_EQ((*beforeRemove)[1], second);
+    ASSERT_EQ(afterRemove->size(), 2u);
+    EXPECT_EQ((*afterRemove)[1], third);
+    EXPECT_EQ(effects.GetCurrentEffect(), 1u);
+    EXPECT_EQ(effects.CurrentEffectName(), "Third");
+
+    // Removing one after it doesn't move it
+    effects.SetCurrentEffectIndex(0);
+    shared_ptr<ILEDEffect> last = third;
+    effects.RemoveEffect(last);
+    EXPECT_EQ(effects.GetCurrentEffect(), 0u);
+    EXPECT_EQ(effects.CurrentEffectName(), "First");
+    EXPECT_EQ(afterRemove->size(), 2u);
+
+    // Snapshots taken before a clear keep their effects alive until they're let go of
+    weak_ptr<ILEDEffect> removed = second;
+    second.reset();
+    last.reset();
+    third.reset();
+    effects.ClearEffects();
+    EXPECT_EQ(effects.EffectCount(), 0u);
+    EXPECT_EQ(effects.CurrentEffectName(), "No Effect Selected");
+    EXPECT_EQ(afterAdd->size(), 1u);
+    EXPECT_FALSE(removed.expired());
+    beforeRemove.reset();
+    EXPECT_TRUE(removed.expired());
+    EXPECT_EQ(afterRemove->size(), 2u);
+    EXPECT_EQ((*afterRemove)[0], first);
+}
+
+TEST_F(EffectsManagerTest, RendersDeterministicEffectsAheadUpToTheClientBuffers)
+{
+    FeatureMappingCanvas canvas(8, 1);
+    canvas.AddFeature(make_shared<LEDFeature>("127.0.0.1", "Deep Buffer", 49152, 8, 1, 0, 0, false, 0, false, 6));
+    canvas.AddFeature(make_shared<LEDFeature>("127.0.0.1", "Shallow Buffer", 49153, 8, 1, 0, 0, false, 0, false, 3));
+
+    EffectsManager effects(30);
+    auto steady = make_shared<StepEffect>("Steady");
+    effects.AddEffect(steady);
+    effects.SetRenderAhead(1s);
+    StartFrameClock(effects, canvas);
+    const auto frame = FrameDuration(effects);
+    const auto lead = frame * 3;
+
+    // The shallowest client buffer caps the lead, and so does a shorter setting
+    EXPECT_EQ(RenderAheadLead(effects, canvas, *steady), lead);
+    effects.SetRenderAhead(50ms);
+    EXPECT_EQ(RenderAheadLead(effects, canvas, *steady), steady_clock::duration(50ms));
+    effects.SetRenderAhead(1s);
+
+    // Frames follow each other immediately until the lead is full, then half of it is slept off
+    steady_clock::time_point next;
+    int burst = 0;
+    for (;; burst++)
+    {
+        ASSERT_LT(burst, 10);
+        next = RenderFrame(effects, canvas);
+        if (next > steady_clock::now())
+            break;
+    }
+    EXPECT_GE(burst, 3);
+    EXPECT_EQ(next, LastFrameTarget(effects) - lead / 2);
+
+    // and each frame advances the effect by the spacing of the frames, not the time it took
+    ASSERT_EQ(steady->deltas.size(), static_cast<size_t>(burst + 1));
+    for (auto delta : steady->deltas)
+        EXPECT_EQ(delta, duration_cast<microseconds>(frame));
+
+    // An effect that follows the clock is rendered in real time
+    auto live = make_shared<StepEffect>("Live", CRGB::Blue, false);
+    EXPECT_EQ(RenderAheadLead(effects, canvas, *live), steady_clock::duration::zero());
+
+    EffectsManager realTime(30);
+    realTime.AddEffect(live);
+    realTime.SetRenderAhead(1s);
+    realTime.SetTransition(TransitionType::Crossfade, 1s);
+    StartFrameClock(realTime, canvas);
+    for (int i = 0; i < 2; i++)
+    {
+        next = RenderFrame(realTime, canvas);
+        EXPECT_EQ(next, LastFrameTarget(realTime));
+    }
+    ASSERT_EQ(live->deltas.size(), 2u);
+    EXPECT_LT(live->deltas[1], duration_cast<microseconds>(frame));
+
+    // and while a transition is still drawing it, so is the deterministic effect taking over
+    auto incoming = make_shared<StepEffect>("Incoming", CRGB::Green);
+    realTime.SetEffects({ incoming });
+    next = RenderFrame(realTime, canvas);
+    EXPECT_EQ(next, LastFrameTarget(realTime));
+    EXPECT_EQ(RenderAheadLead(realTime, canvas, *incoming), steady_clock::duration::zero());
+    ASSERT_EQ(live->deltas.size(), 3u);
+    ASSERT_EQ(incoming->deltas.size(), 1u);
+    EXPECT_LT(incoming->deltas[0], duration_cast<microseconds>(frame));
+}
+
+TEST_F(EffectsManagerTest, FeaturesSendThePresentedFrameAndEncodesFinishInOrder)
+{
+    // A feature that takes longer to encode than a frame lasts, so there's always one in flight
+    class SlowFeature : public LEDFeature
+    {
+    public:
+        mutable atomic<int> encoded = 0;
+        using LEDFeature::LEDFeature;
+        void WriteDataFrame(system_clock::time_point targetTime, uint8_t *frame) const override
+        {
+            this_thread::sleep_for(50ms);
+            LEDFeature::WriteDataFrame(targetTime, frame);
+            encoded++;
+        }
+    };
+
+    // Records how many frames had finished encoding each time one is presented
+    class CountingCanvas : public Canvas
+    {
+    public:
+        shared_ptr<SlowFeature> slow;
+        vector<int> encodedAtPresent;
+        using Canvas::Canvas;
+        void PresentFrame() override
+        {
+            encodedAtPresent.push_back(slow->encoded);
+            Canvas::PresentFrame();
+        }
+    };
+
+    CountingCanvas canvas("Double Buffered", 4, 1);
+    canvas.slow = make_shared<SlowFeature>("127.0.0.1", "Slow Feature", 49154, 4);
+    canvas.AddFeature(canvas.slow);
+
+    // Features see the last presented frame, not the one being drawn
+    canvas.Graphics().Clear(CRGB::Red);
+    EXPECT_EQ(canvas.slow->GetPixelData(), vector<uint8_t>(12, 0));
+    canvas.PresentFrame();
+    canvas.Graphics().Clear(CRGB::Blue);
+    auto pixels = canvas.slow->GetPixelData();
+    EXPECT_EQ(pixels[0], 255);
+    EXPECT_EQ(pixels[2], 0);
+    canvas.encodedAtPresent.clear();
+
+    // Pipelined, each frame is encoded while the next is drawn but done before that one is presented
+    WorkerPool::Instance().SetThreadCount(2);
+    EffectsManager effects(30);
+    effects.AddEffect(make_shared<StepEffect>("Steady"));
+    effects.SetPipelined(true);
+    StartFrameClock(effects, canvas);
+    for (int i = 0; i < 4; i++)
+        RenderFrame(effects, canvas);
+    EXPECT_EQ(canvas.encodedAtPresent, (vector<int>{ 0, 1, 2, 3 }));
+
+    // Stopping waits for the last frame to finish encoding
+    effects.Start(canvas);
+    this_thread::sleep_for(100ms);
+    effects.Stop();
+    EXPECT_EQ(canvas.slow->encoded, static_cast<int>(canvas.encodedAtPresent.size()));
+    for (size_t i = 0; i < canvas.encodedAtPresent.size(); i++)
+        EXPECT_EQ(canvas.encodedAtPresent[i], static_cast<int>(i));
+
+    WorkerPool::Instance().SetThreadCount(0);
+}
+
+TEST(FrameSchedulerTest, StepsEachEntryAtItsOwnRateOnSharedWorkers)
+{
+    auto &scheduler = FrameScheduler::Instance();
+    scheduler.SetThreadCount(2);
+
+    atomic<int> fast = 0, slow = 0, inSlow = 0;
+    atomic<bool> overlapped = false;
+    auto fastId = scheduler.Schedule([&] { fast++; return steady_clock::now() + 10ms; });
+    auto slowId = scheduler.Schedule([&]
+    {
+        if (inSlow++)
+            overlapped = true;
+        slow++;
+        this_thread::sleep_for(5ms);
+        inSlow--;
+        return steady_clock::now() + 50ms;
+    });
+
+    this_thread::sleep_for(500ms);
+    scheduler.Unschedule(fastId);
+    scheduler.Unschedule(slowId);
+
+    int fastCount = fast, slowCount = slow;
+    EXPECT_GE(slowCount, 3);
+    EXPECT_GT(fastCount, 2 * slowCount);
+    EXPECT_FALSE(overlapped);
+
+    this_thread::sleep_for(60ms);                                               // Nothing runs once unscheduled
+    EXPECT_EQ(fast.load(), fastCount);
+    EXPECT_EQ(slow.load(), slowCount);
+
+    scheduler.Schedule([]() -> steady_clock::time_point { throw runtime_error("render failed"); });
+    for (int i = 0; i < 100 && scheduler.ScheduledCount() > 0; i++)
+        this_thread::sleep_for(5ms);
+    EXPECT_EQ(scheduler.ScheduledCount(), 0u);                                  // A failing step is dropped
+
+    scheduler.SetThreadCount(0);
+    EXPECT_FALSE(scheduler.IsEnabled());
+}
+
+TEST(ScheduleTest, CompiledBoundsMatchAndPredictTransitions)
+{
+    auto localTime = [](int year, int month, int day, int hour, int minute, int second)
+    {
+        tm local = {};
+        local.tm_year = year - 1900;
+        local.tm_mon = month - 1;
+        local.tm_mday = day;
+        local.tm_hour = hour;
+        local.tm_min = minute;
+        local.tm_sec = second;
+        local.tm_isdst = -1;
+        return system_clock::from_time_t(mktime(&local));
+    };
+
+    Schedule overnight;
+    overnight.SetStartTime("22:00:00");
+    overnight.SetStopTime("06:00");
+    overnight.SetStopDate("2026-03-10");
+
+    EXPECT_TRUE(overnight.IsActiveAt(localTime(2026, 3, 9, 23, 30, 0)));
+    EXPECT_TRUE(overnight.IsActiveAt(localTime(2026, 3, 10, 6, 0, 0)));        // Stop time is inclusive
+    EXPECT_FALSE(overnight.IsActiveAt(localTime(2026, 3, 10, 6, 0, 1)));
+    EXPECT_FALSE(overnight.IsActiveAt(localTime(2026, 3, 10, 12, 0, 0)));
+    EXPECT_FALSE(overnight.IsActiveAt(localTime(2026, 3, 11, 23, 0, 0)));      // Past the stop date
+
+    auto noon = localTime(2026, 3, 9, 12, 0, 0) + 250ms;
+    EXPECT_EQ(overnight.NextTransition(noon), localTime(2026, 3, 9, 22, 0, 0));
+    EXPECT_EQ(overnight.NextTransition(localTime(2026, 3, 9, 22, 0, 0)), localTime(2026, 3, 10, 0, 0, 0));
+    EXPECT_EQ(overnight.NextTransition(localTime(2026, 3, 10, 3, 0, 0)), localTime(2026, 3, 10, 6, 0, 1));
+
+    Schedule always;
+    EXPECT_TRUE(always.IsActiveAt(noon));
+    EXPECT_EQ(always.NextTransition(noon), system_clock::time_point::max());
+
+    EXPECT_THROW(always.SetStartTime("8 o'clock"), invalid_argument);
+    EXPECT_THROW(always.SetStartDate("2026-02-30"), invalid_argument);
+}
+
+TEST(ReconnectBackoffTest, DoublesWithJitterUpToTheCap)
+{
+    ReconnectBackoff backoff;
+    auto now = steady_clock::now();
+    ASSERT_TRUE(backoff.Ready(now));
+
+    for (uint32_t failure = 0; failure < 10; failure++)
+    {
+        backoff.Failed(now);
+        auto expected = min<milliseconds>(ReconnectBackoff::kBaseDelay * (1u << min<uint32_t>(failure, 6)), ReconnectBackoff::kMaxDelay);
+        auto remaining = backoff.Remaining(now);
+        ASSERT_GE(remaining, expected / 2);
+        ASSERT_LE(remaining, expected);
+        ASSERT_FALSE(backoff.Ready(now));
+    }
+
+    backoff.Succeeded();
+    backoff.Attempted(now);
+    ASSERT_EQ(backoff.Failures(), 0u);
+    ASSERT_TRUE(backoff.Ready(now + ReconnectBackoff::kBaseDelay));
+}
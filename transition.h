@@ -0,0 +1,160 @@
+#pragma once
+using namespace std;
+using namespace chrono;
+
+// Transition
+//
+// Takes a canvas from one effect to the next over a set time instead of cutting straight over.
+// While it runs, the outgoing and incoming effects each draw into a surface of their own and
+// the two are mixed onto the canvas.  Once it's over the canvas holds exactly what the incoming
+// effect drew, so an effect that builds on its previous frame carries on without a seam.
+//
+// Drawing two effects costs about twice as much as drawing one.  If a frame of the transition
+// takes longer than the budget it's given, the outgoing effect is frozen on its last frame for
+// the rest of the transition, leaving one effect to draw plus the mix, which is cheap.
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "global.h"
+#include "interfaces.h"
+#include "basegraphics.h"
+#include "compositor.h"
+#include "surfacecanvas.h"
+
+class Transition
+{
+    TransitionType         _type;
+    steady_clock::duration _duration;
+    steady_clock::duration _elapsed = steady_clock::duration::zero();
+    shared_ptr<ILEDEffect> _outgoing;
+    BaseGraphics           _from;
+    BaseGraphics           _to;
+    vector<uint8_t>        _dissolveMask;           // When each pixel switches over, for Dissolve
+    bool                   _frozen = false;
+
+    // A fixed scramble of the pixel order, so a dissolve looks random but every frame of it can
+    // be reproduced from its progress alone
+
+    static vector<uint8_t> DissolveMask(size_t count)
+    {
+        vector<uint8_t> mask(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t x = static_cast<uint32_t>(i) * 0x9E3779B9u;
+            x = (x ^ (x >> 16)) * 0x85EBCA6Bu;
+            x = (x ^ (x >> 13)) * 0xC2B2AE35u;
+            mask[i] = static_cast<uint8_t>((x ^ (x >> 16)) >> 24);
+        }
+        return mask;
+    }
+
+public:
+    // Transition
+    //
+    // The outgoing effect carries on from what it last drew, which is what's on the canvas
+
+    Transition(TransitionType type, steady_clock::duration duration, shared_ptr<ILEDEffect> outgoing, const ILEDGraphics &current)
+        : _type(type),
+          _duration(duration),
+          _outgoing(std::move(outgoing)),
+          _from(current.Width(), current.Height()),
+          _to(current.Width(), current.Height())
+    {
+        copy(current.GetPixels().begin(), current.GetPixels().end(), _from.Pixels().begin());
+
+        if (_type == TransitionType::Dissolve)
+            _dissolveMask = DissolveMask(current.GetPixels().size());
+    }
+
+    bool IsDone() const
+    {
+        return _elapsed >= _duration;
+    }
+
+    double Progress() const
+    {
+        return IsDone() ? 1.0 : duration<double>(_elapsed) / duration<double>(_duration);
+    }
+
+    // A frozen outgoing effect no longer changes, so only the incoming one matters then
+
+    bool IsDeterministic() const
+    {
+        return _frozen || _outgoing->IsDeterministic();
+    }
+
+    // Render
+    //
+    // Advances both effects by deltaTime and draws the mix of them onto the canvas
+
+    void Render(ICanvas &canvas, ILEDEffect &incoming, microseconds deltaTime, steady_clock::duration budget)
+    {
+        auto &graphics = canvas.Graphics();
+        if (graphics.Width() != _to.Width() || graphics.Height() != _to.Height())
+        {
+            // The canvas changed size under us, so there's nothing sensible to mix
+            _elapsed = _duration;
+            incoming.Update(canvas, deltaTime);
+            return;
+        }
+
+        auto start = steady_clock::now();
+
+        if (!_frozen)
+        {
+            SurfaceCanvas from(canvas, _from);
+            _outgoing->Update(from, deltaTime);
+        }
+
+        SurfaceCanvas to(canvas, _to);
+        incoming.Update(to, deltaTime);
+
+        _elapsed += deltaTime;
+        Mix(graphics.Pixels().data(), graphics.Width(), graphics.Height(), Progress());
+
+        if (!_frozen && steady_clock::now() - start > budget)
+        {
+            logger->debug("Transition on canvas '{}' is over its frame budget, freezing '{}'", canvas.Name(), _outgoing->Name());
+            _frozen = true;
+        }
+    }
+
+private:
+    void Mix(CRGB *dst, uint32_t width, uint32_t height, double progress) const
+    {
+        size_t count = static_cast<size_t>(width) * height;
+        const CRGB *from = _from.GetPixels().data();
+        const CRGB *to = _to.GetPixels().data();
+
+        switch (_type)
+        {
+            case TransitionType::Crossfade:
+                copy_n(from, count, dst);
+                Compositor::Blend(BlendMode::Alpha, dst, to, count, Compositor::OpacityWeight(progress));
+                break;
+
+            case TransitionType::Wipe:
+            {
+                // Left to right, a whole column at a time
+                auto edge = min<uint32_t>(width, static_cast<uint32_t>(lround(progress * width)));
+                for (size_t row = 0; row < count; row += width)
+                {
+                    copy_n(to + row, edge, dst + row);
+                    copy_n(from + row + edge, width - edge, dst + row + edge);
+                }
+                break;
+            }
+
+            case TransitionType::Dissolve:
+                copy_n(from, count, dst);
+                Compositor::Select(dst, to, _dissolveMask.data(), count, Compositor::OpacityWeight(progress));
+                break;
+
+            case TransitionType::Cut:
+                copy_n(to, count, dst);
+                break;
+        }
+    }
+};
@@ -0,0 +1,582 @@
+#pragma once
+using namespace std;
+using namespace chrono;
+
+// UdpSocketChannel
+//
+// An alternative to SocketChannel that sends frames to the client as UDP datagrams.  Over TCP a
+// single lost packet holds up every frame behind it until it has been retransmitted; over UDP
+// a frame that doesn't make it is simply lost, and the next one goes out on time.
+//
+// Frames are the same ones SocketChannel sends (raw or compressed pixel frames), split into
+// fragments that each fit in a single unfragmented datagram.  Every fragment starts with a
+// small header:
+//
+//      DWORD   tag             'NDUP' (0x4E445550)
+//      DWORD   sequence        Frame sequence number, starts at 1 and increments by one per
+//                              frame, skipping 0 when it wraps
+//      WORD    fragmentIndex   Zero based index of this fragment
+//      WORD    fragmentCount   Number of fragments the frame was split into
+//      DWORD   frameLength     Length of the whole frame in bytes
+//
+// followed by up to MaxFragmentPayload bytes of the frame, starting at fragmentIndex times
+// MaxFragmentPayload.  All values are little endian, like the rest of the protocol.
+//
+// A client can reply with ClientResponse datagrams, one per frame it completes, carrying that
+// frame's sequence number.  Gaps in those sequence numbers are counted as lost frames.  A
+// sequence of 0 means the client doesn't report them, which is why frames never use it.
+//
+// UDP channels always run on their own worker thread; the shared socket reactor only handles
+// TCP channels.  Since sends never wait for the client, the queue only backs up if the local
+// network stack does, so the backpressure policy is simplified: Reset empties the queue and
+// every other policy drops the newest frame.
+
+#include <array>
+#include <limits>
+#include <optional>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include "socketchannel.h"
+
+class UdpSocketChannel : public ISocketChannel
+{
+public:
+    static constexpr uint32_t FragmentTag = 0x4E445550;         // 'NDUP'
+    static constexpr size_t FragmentHeaderSize = 16;
+    static constexpr size_t MaxDatagramSize = 1472;             // 1500 byte MTU less IP and UDP headers
+    static constexpr size_t MaxFragmentPayload = MaxDatagramSize - FragmentHeaderSize;
+
+private:
+    static constexpr size_t MaxQueueDepth = 500;
+    static constexpr size_t MaxQueuedBytes = 1024 * 1024 * 10;
+    static constexpr auto ResponsePollInterval = 1000ms;
+    static constexpr unsigned char MulticastTtl = 1;            // Keep multicast frames on the local network
+
+    string _hostName;
+    string _friendlyName;
+    uint16_t _port;
+    uint32_t _id;
+
+    mutable mutex _mutex;
+    mutable mutex _responseMutex;
+
+    atomic<bool> _isConnected = false;
+    atomic<bool> _running = false;
+    int _socketFd = -1;
+
+    ClientResponse _lastClientResponse;
+    SpeedTracker _speedTracker;
+    ReconnectBackoff _backoff;                  // Worker thread only
+
+    uint32_t _reconnectCount = 0;
+    uint32_t _failedConnectCount = 0;
+    string _lastSocketError;
+
+    FrameRing _frameQueue;
+    atomic<bool> _resetRequested = false;
+    atomic<bool> _wakePending = false;
+    WakeEvent _wake;
+    thread _workerThread;
+
+    atomic<uint32_t> _batchMaxFrames = 1;
+    atomic<uint32_t> _batchMaxBytes = 64 * 1024;
+    atomic<BackpressurePolicy> _backpressurePolicy = BackpressurePolicy::Reset;
+    FlowController _flowControl;
+    FrameEncoder _encoder;
+
+    uint32_t _nextSequence = 1;                 // Worker thread only
+    optional<uint32_t> _lastAckedSequence;      // Worker thread only
+    atomic<uint64_t> _sentFrames = 0;
+    atomic<uint64_t> _sentDatagrams = 0;
+    atomic<uint64_t> _sendErrors = 0;
+    atomic<uint64_t> _lostFrames = 0;
+    atomic<uint64_t> _droppedFrames = 0;
+    atomic<uint64_t> _throttledFrames = 0;
+
+public:
+    UdpSocketChannel(const string& hostName, const string& friendlyName, uint16_t port = 49152)
+        : _hostName(hostName),
+          _friendlyName(friendlyName),
+          _port(port),
+          _id(SocketChannel::NextId()),
+          _frameQueue(MaxQueueDepth, MaxQueuedBytes)
+    {
+    }
+
+    ~UdpSocketChannel() override
+    {
+        Stop();
+    }
+
+    uint32_t Id() const override                    { return _id; }
+    SocketTransport Transport() const override      { return SocketTransport::Udp; }
+    const string& HostName() const override         { return _hostName; }
+    const string& FriendlyName() const override     { return _friendlyName; }
+    uint16_t Port() const override                  { return _port; }
+
+    bool IsConnected() const override               { return _isConnected; }
+    uint64_t GetLastBytesPerSecond() const override { return _speedTracker.GetLastBytesPerSecond(); }
+    size_t GetCurrentQueueDepth() const override    { return _frameQueue.Size(); }
+    size_t GetQueueMaxSize() const override         { return MaxQueueDepth; }
+    uint64_t GetSentFrameCount() const override     { return _sentFrames; }
+    uint64_t GetLostFrameCount() const override     { return _lostFrames; }
+    uint64_t GetSentDatagramCount() const           { return _sentDatagrams; }
+    uint64_t GetSendErrorCount() const              { return _sendErrors; }
+
+    uint32_t GetReconnectCount() const override
+    {
+        lock_guard lock(_mutex);
+        return _reconnectCount;
+    }
+
+    uint32_t GetFailedConnectCount() const override
+    {
+        lock_guard lock(_mutex);
+        return _failedConnectCount;
+    }
+
+    string GetLastSocketError() const override
+    {
+        lock_guard lock(_mutex);
+        return _lastSocketError;
+    }
+
+    ClientResponse LastClientResponse() const override
+    {
+        lock_guard lock(_responseMutex);
+        return _lastClientResponse;
+    }
+
+    // Batch limits are kept for the sake of the config, but each frame already goes out as
+    // a run of datagrams with nothing to coalesce
+
+    void SetBatchLimits(uint32_t maxFrames, uint32_t maxBytes) override
+    {
+        _batchMaxFrames = max<uint32_t>(maxFrames, 1);
+        _batchMaxBytes = max<uint32_t>(maxBytes, 1);
+    }
+
+    uint32_t GetBatchMaxFrames() const override     { return _batchMaxFrames; }
+    uint32_t GetBatchMaxBytes() const override      { return _batchMaxBytes; }
+
+    void SetBackpressurePolicy(BackpressurePolicy policy) override
+    {
+        _backpressurePolicy = policy;
+    }
+
+    BackpressurePolicy GetBackpressurePolicy() const override { return _backpressurePolicy; }
+    uint64_t GetDroppedFrameCount() const override  { return _droppedFrames; }
+
+    void SetFlowControl(bool enabled, double targetFill) override
+    {
+        _flowControl.Configure(enabled, targetFill);
+    }
+
+    bool IsFlowControlEnabled() const override      { return _flowControl.IsEnabled(); }
+    double GetFlowTargetFill() const override       { return _flowControl.TargetFill(); }
+    double GetSendRatio() const override            { return _flowControl.SendRatio(); }
+    uint64_t GetThrottledFrameCount() const override { return _throttledFrames; }
+
+    FramePtr CompressFrame(const uint8_t * data, size_t size, size_t headerSize = 0, uint64_t pixelHash = 0) override
+    {
+        return _encoder.Encode(data, size, EncoderEpoch(), headerSize, pixelHash);
+    }
+
+    bool ShouldSendFrame(uint64_t pixelHash) override { return _encoder.ShouldEncode(pixelHash, EncoderEpoch()); }
+
+    void SetSkipUnchanged(bool enabled, milliseconds keepalive) override { _encoder.SetSkipUnchanged(enabled, keepalive); }
+    bool IsSkipUnchangedEnabled() const override    { return _encoder.SkipUnchanged(); }
+    milliseconds GetKeepaliveInterval() const override { return _encoder.Keepalive(); }
+    uint64_t GetSkippedFrameCount() const override  { return _encoder.SkippedFrames(); }
+
+    void RecordEncodeTime(nanoseconds elapsed) override { _encoder.RecordEncodeTime(elapsed); }
+    double GetLastEncodeMicros() const override     { return _encoder.LastEncodeMicros(); }
+    double GetAverageEncodeMicros() const override  { return _encoder.AverageEncodeMicros(); }
+
+    void SetCodec(FrameCodec codec, int level) override { _encoder.Configure(codec, level); }
+    FrameCodec GetCodec() const override            { return _encoder.Codec(); }
+    int GetCompressionLevel() const override        { return _encoder.Level(); }
+    FrameCodec GetActiveCodec() const override      { return _encoder.ActiveCodec(); }
+    double GetCompressionRatio() const override     { return _encoder.Ratio(); }
+
+    bool EnqueueFrame(vector<uint8_t>&& frameData, system_clock::time_point timestamp = system_clock::time_point()) override
+    {
+        return EnqueueFrame(make_shared<const vector<uint8_t>>(std::move(frameData)), timestamp);
+    }
+
+    bool EnqueueFrame(FramePtr frame, system_clock::time_point timestamp = system_clock::time_point()) override
+    {
+        if (!_flowControl.Admit())
+        {
+            _throttledFrames++;
+            return false;
+        }
+
+        if (frame->size() > MaxFragmentPayload * numeric_limits<uint16_t>::max())
+        {
+            logger->warn("Frame of {} bytes is too large to send over UDP to {} [{}]", frame->size(), _hostName, _friendlyName);
+            _droppedFrames++;
+            return false;
+        }
+
+        if (!_frameQueue.TryPush(std::move(frame), timestamp))
+        {
+            _droppedFrames++;
+            if (_backpressurePolicy.load() == BackpressurePolicy::Reset)
+            {
+                logger->debug("Queue is full at {} [{}] dropping queued frames", _hostName, _friendlyName);
+                _resetRequested = true;
+                Wake();
+            }
+            return false;
+        }
+
+        Wake();
+        return true;
+    }
+
+    void Start() override
+    {
+        logger->debug("Starting UDP channel for {} [{}]", _hostName, _friendlyName);
+
+        lock_guard lock(_mutex);
+        if (!_running)
+        {
+            _running = true;
+            _workerThread = thread(&UdpSocketChannel::WorkerLoop, this);
+        }
+    }
+
+    void Stop() override
+    {
+        logger->debug("Stopping UDP channel for {} [{}]", _hostName, _friendlyName);
+        {
+            lock_guard lock(_mutex);
+            _running = false;
+        }
+
+        _wake.Signal();
+        if (_workerThread.joinable())
+            _workerThread.join();
+
+        CloseSocket();
+    }
+
+private:
+
+    void Wake()
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!_wakePending.exchange(true))
+            _wake.Signal();
+    }
+
+    void WorkerLoop()
+    {
+        auto lastPollTime = steady_clock::now();
+        FramePtr frame;
+
+        while (_running)
+        {
+            try
+            {
+                if (_resetRequested.exchange(false))
+                    _droppedFrames += _frameQueue.Clear();
+
+                if (_socketFd == -1 && !_frameQueue.Empty())
+                {
+                    if (_backoff.Ready())
+                        OpenSocket();
+                    if (_socketFd == -1)
+                        _droppedFrames += _frameQueue.Clear();
+                }
+
+                while (_socketFd != -1 && _running && _frameQueue.TryPop(frame))
+                    SendFragments(*frame);
+
+                auto now = steady_clock::now();
+                if (now - lastPollTime >= ResponsePollInterval)
+                {
+                    lastPollTime = now;
+                    _speedTracker.UpdateBytesPerSecond();
+                }
+            }
+            catch (const exception& e)
+            {
+                logger->warn("UdpSocketChannel WorkerLoop exception: {}", e.what());
+                CloseSocket();
+            }
+
+            WaitForWork(lastPollTime + ResponsePollInterval - steady_clock::now());
+        }
+    }
+
+    void WaitForWork(steady_clock::duration timeout)
+    {
+        _wakePending = false;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!_frameQueue.Empty() || _resetRequested || !_running)
+            return;
+
+        pollfd fds[2] = {};
+        fds[0].fd = _wake.Fd();
+        fds[0].events = POLLIN;
+        fds[1].fd = _socketFd;
+        fds[1].events = POLLIN;
+        nfds_t count = _socketFd != -1 ? 2 : 1;
+
+        auto ms = duration_cast<milliseconds>(timeout).count();
+        if (poll(fds, count, static_cast<int>(clamp<int64_t>(ms, 0, ResponsePollInterval.count()))) <= 0)
+            return;
+
+        if (fds[0].revents)
+            _wake.Drain();
+
+        if (count == 2 && fds[1].revents)
+            ReadResponses();
+    }
+
+    bool OpenSocket()
+    {
+        sockaddr_in serverAddr{};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(_port);
+
+        string resolveError;
+        switch (HostResolver::Instance().Lookup(_hostName, serverAddr.sin_addr, resolveError))
+        {
+            case HostResolver::Status::Pending:
+                return false;
+
+            case HostResolver::Status::Failed:
+                RecordFailure(resolveError);
+                return false;
+
+            case HostResolver::Status::Resolved:
+                break;
+        }
+
+        _backoff.Attempted();
+
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd == -1)
+        {
+            RecordFailure("socket failed: " + string(strerror(errno)));
+            return false;
+        }
+
+        // A multicast or broadcast destination lets one datagram feed every client that listens
+        // on it, so features that show the same pixels only need a single channel between them
+
+        const uint32_t address = ntohl(serverAddr.sin_addr.s_addr);
+        if (IN_MULTICAST(address))
+        {
+            unsigned char ttl = MulticastTtl;
+            setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        }
+        else if (address == INADDR_BROADCAST || (address & 0xFF) == 0xFF)
+        {
+            int enable = 1;
+            setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+        }
+
+        // Connecting a UDP socket just fixes its destination, but it also means that ICMP port
+        // unreachable messages come back to us as ECONNREFUSED
+
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1 ||
+            connect(fd, reinterpret_cast<sockaddr *>(&serverAddr), sizeof(serverAddr)) == -1)
+        {
+            RecordFailure("connect failed: " + string(strerror(errno)));
+            close(fd);
+            return false;
+        }
+
+        {
+            lock_guard lock(_mutex);
+            _socketFd = fd;
+            _reconnectCount++;
+            _lastSocketError.clear();
+        }
+
+        _isConnected = true;
+        _backoff.Succeeded();
+        _lastAckedSequence.reset();
+        _flowControl.Reset();
+        logger->debug("Opened UDP channel to {}:{} [{}]", _hostName, _port, _friendlyName);
+        return true;
+    }
+
+    // EncoderEpoch
+    //
+    // Changes whenever a frame may not have reached the client.  Frames lost on the way count
+    // too, so a delta never follows a frame the client didn't get for long.
+
+    uint64_t EncoderEpoch() const
+    {
+        return _droppedFrames + _throttledFrames + _lostFrames + GetReconnectCount();
+    }
+
+    void RecordFailure(const string& error)
+    {
+        _backoff.Failed();
+
+        lock_guard lock(_mutex);
+        _isConnected = false;
+        _failedConnectCount++;
+        _lastSocketError = error;
+    }
+
+    void CloseSocket()
+    {
+        lock_guard lock(_mutex);
+        if (_socketFd != -1)
+        {
+            close(_socketFd);
+            _socketFd = -1;
+        }
+        _isConnected = false;
+    }
+
+    // SendFragments
+    //
+    // Sends one frame as a run of datagrams, each gathered from its header and a slice of the
+    // frame so the frame itself is never copied.  If the network stack is out of buffer space
+    // we wait briefly for it; if a datagram still can't be sent, the rest of the frame is
+    // abandoned, since the client couldn't reassemble it anyway.
+
+    void SendFragments(const vector<uint8_t>& frame)
+    {
+        const uint32_t sequence = _nextSequence;
+        _nextSequence = sequence == UINT32_MAX ? 1 : sequence + 1;
+        const size_t fragmentCount = max<size_t>(1, (frame.size() + MaxFragmentPayload - 1) / MaxFragmentPayload);
+
+        for (size_t index = 0; index < fragmentCount; index++)
+        {
+            const size_t offset = index * MaxFragmentPayload;
+            const size_t length = min(MaxFragmentPayload, frame.size() - offset);
+
+            array<uint8_t, FragmentHeaderSize> header;
+            auto out = Utilities::WriteBytes(header.data(), Utilities::DWORDToBytes(FragmentTag));
+            out = Utilities::WriteBytes(out, Utilities::DWORDToBytes(sequence));
+            out = Utilities::WriteBytes(out, Utilities::WORDToBytes(static_cast<uint16_t>(index)));
+            out = Utilities::WriteBytes(out, Utilities::WORDToBytes(static_cast<uint16_t>(fragmentCount)));
+            Utilities::WriteBytes(out, Utilities::DWORDToBytes(static_cast<uint32_t>(frame.size())));
+
+            iovec iov[2];
+            iov[0].iov_base = header.data();
+            iov[0].iov_len = header.size();
+            iov[1].iov_base = const_cast<uint8_t *>(frame.data()) + offset;
+            iov[1].iov_len = length;
+
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = 2;
+
+            ssize_t sent = sendmsg(_socketFd, &msg, MSG_NOSIGNAL);
+            if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                pollfd pfd;
+                pfd.fd = _socketFd;
+                pfd.events = POLLOUT;
+                if (poll(&pfd, 1, static_cast<int>(kSendTimeout.count())) > 0)
+                    sent = sendmsg(_socketFd, &msg, MSG_NOSIGNAL);
+            }
+
+            if (sent == -1)
+            {
+                _sendErrors++;
+                if (errno == ECONNREFUSED)
+                {
+                    // Nobody is listening right now; keep trying, it costs nothing
+                    lock_guard lock(_mutex);
+                    _isConnected = false;
+                    _lastSocketError = "port unreachable";
+                }
+                else
+                {
+                    logger->debug("UDP send failed for {} [{}] errno={}", _hostName, _friendlyName, errno);
+                    RecordFailure("send failed: " + string(strerror(errno)));
+                    CloseSocket();
+                }
+                return;
+            }
+
+            _sentDatagrams++;
+            _speedTracker.AddBytes(sent);
+        }
+
+        _sentFrames++;
+        _isConnected = true;
+    }
+
+    // ReadResponses
+    //
+    // Reads whatever ClientResponse datagrams the client has sent us
+
+    void ReadResponses()
+    {
+        uint8_t buffer[MaxDatagramSize];
+
+        while (_socketFd != -1)
+        {
+            ssize_t received = recv(_socketFd, buffer, sizeof(buffer), 0);
+            if (received < 0)
+                return;
+
+            ClientResponse response;
+            if (static_cast<size_t>(received) == sizeof(ClientResponse))
+            {
+                memcpy(&response, buffer, sizeof(ClientResponse));
+                response.TranslateClientResponse();
+            }
+            else if (static_cast<size_t>(received) == sizeof(OldClientResponse))
+            {
+                OldClientResponse oldResponse;
+                memcpy(&oldResponse, buffer, sizeof(OldClientResponse));
+                response = oldResponse;
+                response.TranslateClientResponse();
+            }
+            else
+                continue;
+
+            // Each response acknowledges one frame, so any sequence numbers skipped since the
+            // last one belong to frames that were lost on the way
+
+            const uint32_t sequence = static_cast<uint32_t>(response.sequence);
+            if (sequence != 0)
+                OnAcknowledged(sequence);
+
+            _flowControl.OnClientResponse(response.bufferPos, response.bufferSize, _frameQueue.Size());
+
+            lock_guard lock(_responseMutex);
+            _lastClientResponse = response;
+        }
+    }
+
+    // OnAcknowledged
+    //
+    // Sequence numbers wrap, so they're compared as serial numbers: one is newer than another
+    // if it's less than half the range ahead of it.  Acks that arrive out of order are ignored.
+
+    void OnAcknowledged(uint32_t sequence)
+    {
+        if (!_lastAckedSequence)
+        {
+            _lastAckedSequence = sequence;
+            return;
+        }
+
+        const int32_t ahead = static_cast<int32_t>(sequence - *_lastAckedSequence);
+        if (ahead <= 0)
+            return;
+
+        uint32_t missed = static_cast<uint32_t>(ahead) - 1;
+        if (sequence < *_lastAckedSequence && missed > 0)
+            missed--;                                   // Wrapped past 0, which is never sent
+
+        _lostFrames += missed;
+        _lastAckedSequence = sequence;
+    }
+};
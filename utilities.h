@@ -14,8 +14,11 @@ using namespace std;
 #include <cmath>
 #include <cstdint>
 #include <cstring>
+#include <stdexcept>
 #include <zlib.h>
 #include "pixeltypes.h"
+#include "pixelkernels.h"
+#include "colortransform.h"
 
 class Utilities
 {
@@ -50,33 +53,77 @@ public:
     }
 
     static vector<uint8_t> ConvertPixelsToByteArray(const vector<CRGB> &pixels, bool reversed, bool redGreenSwap)
+    {
+        vector<uint8_t> byteArray(pixels.size() * sizeof(CRGB));
+        WritePixels(pixels.data(), pixels.size(), reversed, redGreenSwap, byteArray.data());
+        return byteArray;
+    }
+
+    // WritePixels
+    //
+    // Does the work of ConvertPixelsToByteArray, writing the bytes to a buffer the caller
+    // provides so frames can be assembled in place.  out must hold count * 3 bytes.  A transform
+    // that isn't the identity is looked up in the same pass that orders the bytes.
+
+    static void WritePixels(const CRGB *pixels, size_t count, bool reversed, bool redGreenSwap, uint8_t *out,
+                            const ColorTransform *transform = nullptr)
     {
         static_assert(sizeof(CRGB) == 3);
 
-        vector<uint8_t> byteArray(pixels.size() * sizeof(CRGB));
+        if (transform && !transform->IsIdentity())
+        {
+            WriteTransformedPixels(pixels, count, reversed, redGreenSwap, out, *transform);
+            return;
+        }
 
         if (!reversed && !redGreenSwap)
         {
-            memcpy(byteArray.data(), pixels.data(), pixels.size() * sizeof(CRGB));
-            return byteArray;
+            memcpy(out, pixels, count * sizeof(CRGB));
+            return;
+        }
+
+        if (!reversed)
+        {
+            PixelKernels::Active().swapRedGreen(out, reinterpret_cast<const uint8_t *>(pixels), count);
+            return;
         }
 
-        size_t index = 0;
         auto writePixel = [&](const CRGB &pixel)
         {
-            byteArray[index++] = redGreenSwap ? pixel.g : pixel.r;
-            byteArray[index++] = redGreenSwap ? pixel.r : pixel.g;
-            byteArray[index++] = pixel.b;
+            *out++ = redGreenSwap ? pixel.g : pixel.r;
+            *out++ = redGreenSwap ? pixel.r : pixel.g;
+            *out++ = pixel.b;
         };
 
-        if (reversed)
-            for (auto it = pixels.rbegin(); it != pixels.rend(); ++it)
-                writePixel(*it);
-        else 
-            for (const auto &pixel : pixels)
-                writePixel(pixel);
+        for (size_t i = count; i-- > 0; )
+            writePixel(pixels[i]);
+    }
 
-        return byteArray;
+    // WriteTransformedPixels
+    //
+    // The lookup version of WritePixels.  The swap only decides which table feeds which byte, so
+    // every combination is still one load, one lookup and one store per byte.
+
+    static void WriteTransformedPixels(const CRGB *pixels, size_t count, bool reversed, bool redGreenSwap, uint8_t *out,
+                                       const ColorTransform &transform)
+    {
+        const uint8_t *red   = transform.Table(0).data();
+        const uint8_t *green = transform.Table(1).data();
+        const uint8_t *blue  = transform.Table(2).data();
+
+        const size_t first = redGreenSwap ? 1 : 0;
+        const uint8_t *firstTable  = redGreenSwap ? green : red;
+        const uint8_t *secondTable = redGreenSwap ? red : green;
+
+        auto source = reinterpret_cast<const uint8_t *>(pixels);
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint8_t *pixel = source + (reversed ? count - 1 - i : i) * sizeof(CRGB);
+            out[0] = firstTable[pixel[first]];
+            out[1] = secondTable[pixel[1 - first]];
+            out[2] = blue[pixel[2]];
+            out += sizeof(CRGB);
+        }
     }
 
     // The following XXXXToBytes functions produce a bytestream in the little-endian
@@ -163,6 +210,49 @@ public:
         }
     }
 
+    // WriteBytes
+    //
+    // Copies the output of one of the XXXXToBytes functions to out and returns the position
+    // just past it, for writing headers directly into a frame buffer
+
+    template <size_t N>
+    static uint8_t *WriteBytes(uint8_t *out, const array<uint8_t, N> &bytes)
+    {
+        memcpy(out, bytes.data(), N);
+        return out + N;
+    }
+
+    // HashBytes
+    //
+    // A fast, non-cryptographic 64 bit hash for telling whether two frames' pixels are the same.
+    // Consumes eight bytes per multiply, so hashing even a large canvas costs far less than
+    // compressing it.  Never returns 0, which callers can use to mean "no hash".
+
+    static uint64_t HashBytes(const uint8_t *data, size_t size)
+    {
+        constexpr uint64_t prime1 = 0x9E3779B97F4A7C15ull;
+        constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+
+        uint64_t hash = prime2 ^ (size * prime1);
+        size_t i = 0;
+
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ (word * prime2)) * prime1;
+            hash ^= hash >> 31;
+        }
+
+        for (; i < size; i++)
+            hash = (hash ^ (data[i] * prime2)) * prime1;
+
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        return hash ? hash : 1;
+    }
+
     // Combines multiple byte arrays into one.  My masterpiece for the day :-)
 
     template <typename... Arrays>
@@ -186,53 +276,43 @@ public:
 
     static vector<uint8_t> Compress(const vector<uint8_t> &data)
     {
-        // Allocate initial buffer size
-        constexpr size_t bufferIncrement = 1024;
-        vector<uint8_t> compressedData(bufferIncrement);
+        vector<uint8_t> compressedData(compressBound(static_cast<uLong>(data.size())));
+        compressedData.resize(Compress(data.data(), data.size(), compressedData.data(), compressedData.size()));
+        return compressedData;
+    }
+
+    // Compress
+    //
+    // Compresses size bytes of data straight into out and returns the compressed length.  A
+    // buffer of compressBound(size) bytes is always big enough.
 
+    static size_t Compress(const uint8_t *data, size_t size, uint8_t *out, size_t capacity)
+    {
         // Initialize zlib stream
         z_stream stream{};
         stream.zalloc = Z_NULL;
         stream.zfree = Z_NULL;
         stream.opaque = Z_NULL;
 
-        // Set input data
-        stream.next_in = const_cast<Bytef *>(data.data());
-        stream.avail_in = static_cast<uInt>(data.size());
-
         // Initialize deflate process with optimal compression level
         if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK)
         {
             throw runtime_error("Failed to initialize zlib compression");
         }
 
-        // Compress the data
-        int result;
-        do
-        { // Ensure the output buffer is large enough
-            if (stream.total_out >= compressedData.size())
-                compressedData.resize(compressedData.size() + bufferIncrement);
-
-            // Set the output buffer
-            stream.next_out = compressedData.data() + stream.total_out;
-            stream.avail_out = static_cast<uInt>(compressedData.size() - stream.total_out);
-
-            // Perform the compression
-            result = deflate(&stream, Z_FINISH);
-            if (result == Z_STREAM_ERROR)
-            {
-                deflateEnd(&stream);
-                throw runtime_error("Error during zlib compression");
-            }
-        } while (result != Z_STREAM_END);
-
-        // Finalize and clean up
+        stream.next_in = const_cast<Bytef *>(data);
+        stream.avail_in = static_cast<uInt>(size);
+        stream.next_out = out;
+        stream.avail_out = static_cast<uInt>(capacity);
+
+        // With room for the whole output, a single call finishes the stream
+        int result = deflate(&stream, Z_FINISH);
+        size_t compressedSize = stream.total_out;
         deflateEnd(&stream);
 
-        // Resize the vector to the actual size of the compressed data
-        compressedData.resize(stream.total_out);
+        if (result != Z_STREAM_END)
+            throw runtime_error("Error during zlib compression");
 
-        return compressedData;
+        return compressedSize;
     }
 };
-
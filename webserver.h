@@ -468,7 +468,7 @@ public:
                 {
                     shared_lock readLock(_apiMutex);
                     auto canvas = _controller.GetCanvasById(canvasId);
-                    const auto &gfx = canvas->Graphics();
+                    const auto &gfx = canvas->FrontGraphics();
                     const auto &pixels = gfx.GetPixels();
                     uint16_t w = static_cast<uint16_t>(gfx.Width());
                     uint16_t h = static_cast<uint16_t>(gfx.Height());
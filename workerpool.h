@@ -0,0 +1,264 @@
+#pragma once
+using namespace std;
+
+// WorkerPool
+//
+// A pool of threads shared by every canvas for CPU-bound work that can be split up, like
+// building and compressing the frames for a canvas's features.  Each worker has its own queue;
+// tasks are dealt out to the queues in turn, and a worker whose queue runs dry steals from the
+// others before going to sleep, so one canvas with a slow feature can't leave threads idle
+// while work is waiting.
+//
+// With a thread count of zero (the default) nothing is parallel and ParallelFor simply runs
+// everything on the calling thread.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+    struct Queue
+    {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    mutable mutex _mutex;                       // Guards the set of workers
+    vector<unique_ptr<Queue>> _queues;
+    vector<thread> _threads;
+
+    mutex _sleepMutex;
+    condition_variable _wake;
+    atomic<size_t> _queued = 0;
+    atomic<size_t> _nextQueue = 0;
+    atomic<bool> _stopping = false;
+
+    WorkerPool() = default;
+
+public:
+    // Instance
+    //
+    // Deliberately never destroyed, like the other process-wide singletons, since canvases
+    // may still be rendering during static destruction
+
+    static WorkerPool & Instance()
+    {
+        static WorkerPool * instance = new WorkerPool();
+        return *instance;
+    }
+
+    // SetThreadCount
+    //
+    // Replaces the workers with count new ones.  Work that's already queued is finished first.
+
+    void SetThreadCount(size_t count)
+    {
+        lock_guard lock(_mutex);
+        if (count == _threads.size())
+            return;
+
+        StopWorkers();
+
+        _queues.clear();
+        for (size_t i = 0; i < count; i++)
+            _queues.push_back(make_unique<Queue>());
+
+        for (size_t i = 0; i < count; i++)
+            _threads.emplace_back(&WorkerPool::WorkerLoop, this, i);
+    }
+
+    size_t ThreadCount() const
+    {
+        lock_guard lock(_mutex);
+        return _threads.size();
+    }
+
+    // ParallelFor
+    //
+    // Calls body(i) for every i below count and returns once all of them are done.  The calling
+    // thread works through the indices too, so progress never depends on a worker being free.
+    // The first exception thrown by body is rethrown here once everything has finished.
+
+    void ParallelFor(size_t count, const function<void(size_t)> & body)
+    {
+        unique_lock poolLock(_mutex);
+        size_t helpers = count > 1 ? min(count - 1, _threads.size()) : 0;
+
+        if (helpers == 0)
+        {
+            poolLock.unlock();
+            for (size_t i = 0; i < count; i++)
+                body(i);
+            return;
+        }
+
+        // Helpers that only get to run after everything is done must not touch this stack
+        // frame, so everything they need lives in a shared state
+
+        struct State
+        {
+            const function<void(size_t)> * body;
+            size_t count;
+            atomic<size_t> next = 0;
+            atomic<size_t> done = 0;
+            mutex lock;
+            condition_variable finished;
+            exception_ptr error;
+
+            void Work()
+            {
+                size_t completed = 0;
+                for (size_t i = next++; i < count; i = next++)
+                {
+                    try
+                    {
+                        (*body)(i);
+                    }
+                    catch (...)
+                    {
+                        lock_guard guard(lock);
+                        if (!error)
+                            error = current_exception();
+                    }
+                    completed++;
+                }
+
+                if (completed && done.fetch_add(completed) + completed == count)
+                {
+                    lock_guard guard(lock);
+                    finished.notify_all();
+                }
+            }
+        };
+
+        auto state = make_shared<State>();
+        state->body = &body;
+        state->count = count;
+
+        for (size_t i = 0; i < helpers; i++)
+            Submit([state] { state->Work(); });
+        poolLock.unlock();
+
+        state->Work();
+
+        unique_lock lock(state->lock);
+        state->finished.wait(lock, [&] { return state->done == count; });
+        if (state->error)
+            rethrow_exception(state->error);
+    }
+
+    // Post
+    //
+    // Runs task on a worker and returns a future for its completion.  Without workers the task
+    // runs on the calling thread before Post returns.
+
+    future<void> Post(function<void()> task)
+    {
+        auto packaged = make_shared<packaged_task<void()>>(std::move(task));
+        auto result = packaged->get_future();
+
+        unique_lock poolLock(_mutex);
+        if (_threads.empty())
+        {
+            poolLock.unlock();
+            (*packaged)();
+            return result;
+        }
+
+        Submit([packaged] { (*packaged)(); });
+        return result;
+    }
+
+private:
+    // Submit
+    //
+    // Queues a task on the next worker's queue.  The caller must hold _mutex.
+
+    void Submit(function<void()> task)
+    {
+        {
+            lock_guard lock(_sleepMutex);
+            _queued++;
+        }
+
+        {
+            auto & queue = *_queues[_nextQueue++ % _queues.size()];
+            lock_guard queueLock(queue.lock);
+            queue.tasks.push_back(std::move(task));
+        }
+        _wake.notify_one();
+    }
+
+    // TakeTask
+    //
+    // The newest task from our own queue, since its data is most likely still in cache, or
+    // failing that the oldest task from someone else's
+
+    bool TakeTask(size_t index, function<void()> & task)
+    {
+        for (size_t offset = 0; offset < _queues.size(); offset++)
+        {
+            auto & queue = *_queues[(index + offset) % _queues.size()];
+            lock_guard lock(queue.lock);
+            if (queue.tasks.empty())
+                continue;
+
+            if (offset == 0)
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+
+            _queued--;
+            return true;
+        }
+        return false;
+    }
+
+    void WorkerLoop(size_t index)
+    {
+        while (true)
+        {
+            function<void()> task;
+            if (TakeTask(index, task))
+            {
+                task();
+                continue;
+            }
+
+            unique_lock lock(_sleepMutex);
+            if (_stopping && _queued == 0)
+                return;
+            _wake.wait(lock, [this] { return _queued > 0 || _stopping; });
+        }
+    }
+
+    void StopWorkers()
+    {
+        {
+            lock_guard lock(_sleepMutex);
+            _stopping = true;
+        }
+        _wake.notify_all();
+
+        for (auto & worker : _threads)
+            worker.join();
+        _threads.clear();
+
+        _stopping = false;
+    }
+};